@@ -0,0 +1,778 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+// Standalone benchmark of the query engine and the persistence paths.
+// Storage and mediator messages are replaced by in-memory stubs, so it runs
+// offline. Every case prints one JSON object per line to stdout.
+//
+// Every query result is checked; a case with failing queries is reported on
+// stderr and the run exits with 1. With --columnar the queried collection is
+// registered as readonly, so it gets a column store.
+//
+// Usage: database_benchmark [--rows=N] [--fields=N] [--iterations=N]
+//          [--scan-iterations=N] [--bulk=N] [--range=N] [--miss-ratio=F]
+//          [--distribution=sequential|uniform|skewed] [--seed=N]
+//          [--directory=PATH] [--key-filters] [--columnar]
+//
+// Build it from the directory of the database sources with the engine
+// headers and libraries the game is linked with, for example:
+//   c++ -std=c++11 -O2 -DNDEBUG -pthread -I. -I<engine include dirs>
+//       benchmark/database_benchmark.cpp *.cpp <engine libraries>
+//       -o database_benchmark
+// and compare runs of the same options, one JSON line per case:
+//   ./database_benchmark --rows=100000 > before.jsonl
+//   ./database_benchmark --rows=100000 --key-filters --columnar > after.jsonl
+
+#include "parts/include.h"
+#include "database.h"
+#include "collection.h"
+#include "query.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <math.h>
+#include <new>
+#include <random>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+std::atomic<size_t> g_iAllocationCount(0);
+
+}
+
+void* operator new(size_t iSize) {
+  ++g_iAllocationCount;
+  void* pMemory = malloc(iSize > 0 ? iSize : 1);
+  if (pMemory == NULL) {
+    throw std::bad_alloc();
+  }
+  return pMemory;
+}
+
+void* operator new[](size_t iSize) {
+  return operator new(iSize);
+}
+
+void operator delete(void* pMemory) noexcept {
+  free(pMemory);
+}
+
+void operator delete[](void* pMemory) noexcept {
+  free(pMemory);
+}
+
+void operator delete(void* pMemory, size_t) noexcept {
+  free(pMemory);
+}
+
+void operator delete[](void* pMemory, size_t) noexcept {
+  free(pMemory);
+}
+
+namespace parts {
+namespace db {
+
+struct BenchmarkOptions {
+  size_t      m_iRows;
+  size_t      m_iFields;
+  size_t      m_iIterations;
+  size_t      m_iScanIterations;
+  size_t      m_iBulkSize;
+  int         m_iRange;
+  double      m_fMissRatio;
+  std::string m_sDistribution;
+  unsigned    m_iSeed;
+  std::string m_sDirectory;
+  bool        m_bUseKeyFilters;
+  bool        m_bIsColumnar;
+
+  BenchmarkOptions()
+    : m_iRows(100000),
+      m_iFields(8),
+      m_iIterations(10000),
+      m_iScanIterations(20),
+      m_iBulkSize(1000),
+      m_iRange(100),
+      m_fMissRatio(0.0),
+      m_sDistribution("uniform"),
+      m_iSeed(1),
+      m_sDirectory("."),
+      m_bUseKeyFilters(false),
+      m_bIsColumnar(false) {}
+};
+
+class BenchmarkDatabase : public Database {
+ public:
+  BenchmarkDatabase(const nE_DataTable* pOptionTable)
+    : Database(pOptionTable) {
+    s_pInstance = this;
+  }
+
+  virtual ~BenchmarkDatabase() {
+    s_pInstance = NULL;
+  }
+
+  using Database::Load;
+  using Database::LoadWritableCollections;
+  using Database::SaveWritableCollections;
+  using Database::CreateWritableCollection;
+  using Database::CreateReadonlyCollection;
+  using Database::ReadCollectionData;
+  using Database::ReadCollection;
+  using Database::AddReadonlyCollection;
+
+  void RemoveCollection(const std::string& sCollectionName) {
+    m_Collections.erase(sCollectionName);
+    UpdateCollectionHandle(sCollectionName, CollectionPointer());
+    m_ColumnStores.erase(sCollectionName);
+    ResetKeyFilters(sCollectionName);
+    OnCollectionChanged(sCollectionName);
+  }
+
+ protected:
+  virtual bool StorageDataExists(const std::string& sKey) {
+    return (m_Storage.find(sKey) != m_Storage.end());
+  }
+
+  virtual bool ReadStorageData(const std::string& sKey, std::string& sData) {
+    std::map<std::string, std::string>::const_iterator it = m_Storage.find(sKey);
+    if (it == m_Storage.end()) {
+      return false;
+    }
+    sData = it->second;
+    return true;
+  }
+
+  virtual void WriteStorageData(const std::string& sKey,
+                                const std::string& sData) {
+    m_Storage[sKey] = sData;
+  }
+
+  virtual void SendDbReady() {}
+  virtual void SendCollectionUpdated(const std::string& sCollectionName) {}
+
+ private:
+  std::map<std::string, std::string> m_Storage;
+};
+
+class CollectionGenerator {
+ public:
+  CollectionGenerator(const BenchmarkOptions& options)
+    : m_Options(options),
+      m_Random(options.m_iSeed) {
+    m_vKeys.resize(options.m_iRows);
+    for (size_t i = 0; i < options.m_iRows; ++i) {
+      m_vKeys[i] = GenerateKey((int)i);
+    }
+  }
+
+  nE_DataTable* CreateItem(int iId) {
+    nE_DataTable* pItem = new nE_DataTable();
+    pItem->Push(Collection::DEFAULT_INDEX_NAME, iId);
+    pItem->Push("key", (iId < (int)m_vKeys.size() ? m_vKeys[iId] :
+                        GenerateKey(iId)));
+    for (size_t i = 0; i < m_Options.m_iFields; ++i) {
+      char sField[16];
+      sprintf(sField, "f%d", (int)i);
+      if (i % 2 == 0) {
+        pItem->Push(sField, (int)(m_Random() % 1000));
+      } else {
+        char sValue[32];
+        sprintf(sValue, "value%u", (unsigned)(m_Random() % 1000));
+        pItem->Push(sField, sValue);
+      }
+    }
+    return pItem;
+  }
+
+  nE_DataPointer CreateCollection(const std::string& sCollectionName,
+                                  int iFirstId, size_t iRows) {
+    nE_DataTable* pCollection = new nE_DataTable();
+    pCollection->Push("name", sCollectionName);
+    pCollection->PushNewTable("indices")->Push("key", "key");
+    nE_DataArray* pItems = pCollection->PushNewArray("items");
+    for (size_t i = 0; i < iRows; ++i) {
+      pItems->Push(CreateItem(iFirstId + (int)i));
+    }
+    return nE_DataPointer(pCollection);
+  }
+
+  int RandomId() {
+    return (int)(m_Random() % m_Options.m_iRows);
+  }
+
+  int RandomLookupKey() {
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    if (distribution(m_Random) < m_Options.m_fMissRatio) {
+      return (int)(m_Options.m_iRows + m_Random() % m_Options.m_iRows);
+    }
+    return m_vKeys[RandomId()];
+  }
+
+ private:
+  int GenerateKey(int iId) {
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    if (m_Options.m_sDistribution == "sequential") {
+      return iId;
+    } else if (m_Options.m_sDistribution == "skewed") {
+      return (int)(m_Options.m_iRows * pow(distribution(m_Random), 3.0));
+    } else {
+      return (int)(m_Random() % m_Options.m_iRows);
+    }
+  }
+
+ private:
+  const BenchmarkOptions& m_Options;
+  std::mt19937            m_Random;
+  std::vector<int>        m_vKeys;
+};
+
+class Benchmark {
+ public:
+  typedef std::function<void(size_t)> Operation;
+
+ public:
+  Benchmark(const BenchmarkOptions& options)
+    : m_Options(options),
+      m_Generator(options),
+      m_iNextId((int)options.m_iRows),
+      m_sStoreCollection(options.m_bIsColumnar ? "bench_store" : "bench"),
+      m_bHasFailed(false) {
+    nE_DataTable optionTable;
+    optionTable.Push("directory", "");
+    optionTable.PushNewArray("collections");
+    optionTable.PushNewArray("writable_collections");
+    optionTable.Push("key_filters", options.m_bUseKeyFilters);
+    optionTable.Push("columnar", options.m_bIsColumnar);
+    m_pDatabase.reset(new BenchmarkDatabase(&optionTable));
+  }
+
+  bool RunAll() {
+    if (m_Options.m_bIsColumnar) {
+      // Column stores are built for readonly collections only; the
+      // persistence cases get a writable copy of their own.
+      m_pDatabase->CreateReadonlyCollection(m_Generator.CreateCollection(
+                                              "bench", 0, m_Options.m_iRows));
+    }
+    m_pDatabase->CreateWritableCollection(m_Generator.CreateCollection(
+                                            m_sStoreCollection, 0,
+                                            m_Options.m_iRows));
+    m_pDatabase->CreateWritableCollection(m_Generator.CreateCollection(
+                                            "bench_write", 0, 0));
+    m_pDatabase->Load();
+
+    if (!RunChecks()) {
+      return false;
+    }
+    RunFindCases();
+    RunWriteCases();
+    RunPersistenceCases();
+    return !m_bHasFailed;
+  }
+
+ private:
+  nE_DataTable* CreateQuery(const std::string& sQueryType,
+                            const std::string& sCollectionName,
+                            const std::string& sIndexName) {
+    nE_DataTable* pQuery = new nE_DataTable();
+    pQuery->Push("query", sQueryType);
+    pQuery->Push("collection", sCollectionName);
+    if (!sIndexName.empty()) {
+      pQuery->Push("index", sIndexName);
+    }
+    pQuery->Push("alias", "item");
+    pQuery->Push("result", "item");
+    return pQuery;
+  }
+
+  // Results that must not depend on the chosen execution path are compared
+  // once before timing, so a fast but wrong path fails the run.
+  bool RunChecks() {
+    return CheckCoveringIndex();
+  }
+
+  bool CheckCoveringIndex() {
+    // The index name differs from its field, the narrow entries must still
+    // hold the key field.
+    nE_DataPointer pData = m_Generator.CreateCollection("bench_covering", 0,
+                           std::min(m_Options.m_iRows, (size_t)1000));
+    nE_DataTable* pCollection = pData->AsTable();
+    pCollection->Get("indices")->AsTable()->Push("by_key", "key");
+    pCollection->PushNewTable("include")->PushNewArray("by_key")->Push("f0");
+    m_pDatabase->CreateReadonlyCollection(pData);
+
+    nE_DataTable fullQuery;
+    fullQuery.Push("query", "find_all");
+    fullQuery.Push("collection", "bench_covering");
+    fullQuery.Push("index", "by_key");
+    fullQuery.Push("alias", "item");
+    fullQuery.Push("result", "item");
+    nE_DataTable coveredQuery;
+    coveredQuery.Push("query", "find_all");
+    coveredQuery.Push("collection", "bench_covering");
+    coveredQuery.Push("index", "by_key");
+    coveredQuery.Push("alias", "item");
+    nE_DataTable* pResult = coveredQuery.PushNewTable("result");
+    pResult->Push("key", "item.key");
+    pResult->Push("f0", "item.f0");
+
+    // The covered query runs twice: entries are made on the first read.
+    QueryResultPointer pFull = m_pDatabase->ExecuteQuery(&fullQuery);
+    m_pDatabase->ExecuteQuery(&coveredQuery);
+    QueryResultPointer pCovered = m_pDatabase->ExecuteQuery(&coveredQuery);
+    m_pDatabase->RemoveCollection("bench_covering");
+    if (!CheckResult("covering_index", pFull) ||
+        !CheckResult("covering_index", pCovered)) {
+      return false;
+    }
+    const nE_DataArray* pFullItems = pFull->GetResult()->AsArray();
+    const nE_DataArray* pCoveredItems = pCovered->GetResult()->AsArray();
+    bool bIsEqual = (pFullItems != NULL && pCoveredItems != NULL &&
+                     pFullItems->Size() == pCoveredItems->Size());
+    for (size_t i = 0; bIsEqual && i < pFullItems->Size(); ++i) {
+      const nE_DataTable* pFullItem = pFullItems->Get(i)->AsTable();
+      const nE_DataTable* pCoveredItem = pCoveredItems->Get(i)->AsTable();
+      bIsEqual = (pFullItem != NULL && pCoveredItem != NULL &&
+                  pCoveredItem->IsExist("key") &&
+                  nE_DataUtils::GetAsInt(pFullItem, "key", -1) ==
+                  nE_DataUtils::GetAsInt(pCoveredItem, "key", -1));
+    }
+    if (!bIsEqual) {
+      fprintf(stderr, "Check 'covering_index' failed: the covered result "
+              "differs from the item result.\n");
+    }
+    return bIsEqual;
+  }
+
+  bool CheckResult(const std::string& sCase, QueryResultPointer pResult) {
+    if (pResult ==(QueryResultPointer) NULL || pResult->HasErrors()) {
+      fprintf(stderr, "Check '%s' failed: %s\n", sCase.c_str(),
+              (pResult ==(QueryResultPointer) NULL ? "no result" :
+               pResult->GetErrors().c_str()));
+      return false;
+    }
+    return true;
+  }
+
+  void ExecuteQueries(const std::string& sCase,
+                      const std::vector<nE_DataTablePointer>& queries,
+                      size_t iItemsPerOperation = 1) {
+    size_t iErrorCount = 0;
+    std::string sError;
+    Run(sCase, queries.size(), iItemsPerOperation, Operation(), [&](size_t i) {
+      QueryResultPointer pResult = m_pDatabase->ExecuteQuery(queries[i].get());
+      if (pResult->HasErrors() && iErrorCount++ == 0) {
+        sError = pResult->GetErrors();
+      }
+    });
+    ReportErrors(sCase, iErrorCount, queries.size(), sError);
+  }
+
+  void ReportErrors(const std::string& sCase, size_t iErrorCount,
+                    size_t iCount, const std::string& sError) {
+    if (iErrorCount == 0) {
+      return;
+    }
+    fprintf(stderr, "Case '%s' failed: %u of %u queries returned errors, "
+            "the first one: %s\n", sCase.c_str(), (unsigned)iErrorCount,
+            (unsigned)iCount, sError.c_str());
+    m_bHasFailed = true;
+  }
+
+  void RunFindCases() {
+    std::vector<nE_DataTablePointer> queries;
+
+    for (size_t i = 0; i < m_Options.m_iIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("find", "bench", "key");
+      pQuery->PushNewTable("criteria")->Push("like", m_Generator.RandomLookupKey());
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("find", queries);
+
+    queries.clear();
+    for (size_t i = 0; i < m_Options.m_iScanIterations; ++i) {
+      queries.push_back(nE_DataTablePointer(CreateQuery("find_all", "bench", "")));
+    }
+    ExecuteQueries("find_all_all", queries, m_Options.m_iRows);
+
+    queries.clear();
+    for (size_t i = 0; i < m_Options.m_iIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("find_all", "bench", "key");
+      pQuery->PushNewTable("criteria")->Push("like", m_Generator.RandomLookupKey());
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("find_all_like", queries);
+
+    queries.clear();
+    for (size_t i = 0; i < m_Options.m_iIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("find_all", "bench", "key");
+      nE_DataTable* pCriteria = pQuery->PushNewTable("criteria");
+      int iMin = m_Generator.RandomLookupKey();
+      pCriteria->Push("min", iMin);
+      pCriteria->Push("max", iMin + m_Options.m_iRange);
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("find_all_min_max", queries);
+
+    queries.clear();
+    for (size_t i = 0; i < m_Options.m_iIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("find_all", "bench", "key");
+      nE_DataArray* pIn = pQuery->PushNewTable("criteria")->PushNewArray(
+                            "exists_in");
+      for (int j = 0; j < 16; ++j) {
+        pIn->Push(m_Generator.RandomLookupKey());
+      }
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("find_all_in", queries, 16);
+
+    queries.clear();
+    for (size_t i = 0; i < m_Options.m_iScanIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("find_all", "bench", "");
+      nE_DataTable* pWhere = pQuery->PushNewTable("where");
+      pWhere->Push("field", "f0");
+      pWhere->Push("op", ">=");
+      pWhere->Push("value", 990);
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("find_all_where", queries, m_Options.m_iRows);
+
+    queries.clear();
+    for (size_t i = 0; i < m_Options.m_iIterations; ++i) {
+      nE_DataTable* pQuery = new nE_DataTable();
+      pQuery->Push("query", "join");
+      nE_DataTable* pOuter = CreateQuery("find_all", "bench", "key");
+      pOuter->Push("alias", "outer");
+      nE_DataTable* pCriteria = pOuter->PushNewTable("criteria");
+      int iMin = m_Generator.RandomLookupKey();
+      pCriteria->Push("min", iMin);
+      pCriteria->Push("max", iMin + m_Options.m_iRange);
+      pQuery->Push("outer", pOuter);
+      nE_DataTable* pInner = pQuery->PushNewTable("inner");
+      pInner->Push("collection", "bench");
+      pInner->Push("index", "key");
+      pInner->Push("alias", "item");
+      pQuery->Push("key", "outer.f0");
+      pQuery->Push("result", "item");
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("join", queries);
+
+    std::vector<nE_DataArrayPointer> queryArrays;
+    for (size_t i = 0; i < m_Options.m_iIterations / 16; ++i) {
+      nE_DataArrayPointer pQueryArray(new nE_DataArray());
+      for (int j = 0; j < 16; ++j) {
+        nE_DataTable* pQuery = CreateQuery("find", "bench", "key");
+        pQuery->PushNewTable("criteria")->Push("like",
+                                              m_Generator.RandomLookupKey());
+        pQueryArray->Push(pQuery);
+      }
+      queryArrays.push_back(pQueryArray);
+    }
+    size_t iErrorCount = 0;
+    Run("execute_query_array", queryArrays.size(), 16, Operation(),
+    [&](size_t i) {
+      if (!m_pDatabase->ExecuteQueryArray(queryArrays[i].get())) {
+        ++iErrorCount;
+      }
+    });
+    ReportErrors("execute_query_array", iErrorCount, queryArrays.size(),
+                 "a query of the array failed");
+
+    Run("get_collection_by_name", m_Options.m_iIterations, 1, Operation(),
+    [&](size_t i) {
+      m_pDatabase->GetCollection("bench");
+    });
+
+    Database::CollectionHandle iCollectionHandle =
+      m_pDatabase->GetCollectionHandle("bench");
+    Database::IndexHandle iIndexHandle = m_pDatabase->GetIndexHandle(
+                                           iCollectionHandle, "key");
+    Run("get_index_by_handle", m_Options.m_iIterations, 1, Operation(),
+    [&](size_t i) {
+      m_pDatabase->GetIndex(iIndexHandle);
+    });
+  }
+
+  void RunWriteCases() {
+    std::vector<nE_DataTablePointer> queries;
+
+    int iFirstId = m_iNextId;
+    for (size_t i = 0; i < m_Options.m_iIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("insert", "bench_write", "");
+      pQuery->Push("value", m_Generator.CreateItem(m_iNextId++));
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("insert", queries);
+
+    queries.clear();
+    for (size_t i = 0; i < m_Options.m_iIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("update", "bench_write", "");
+      pQuery->PushNewTable("criteria")->Push("like", iFirstId + (int)i);
+      pQuery->PushNewTable("set")->Push("f0", (int)i);
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("update", queries);
+
+    queries.clear();
+    for (size_t i = 0; i < m_Options.m_iIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("delete", "bench_write", "");
+      pQuery->PushNewTable("criteria")->Push("like", iFirstId + (int)i);
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("delete", queries);
+
+    const size_t iBulkIterations = std::max((size_t)1,
+                                            m_Options.m_iScanIterations);
+    queries.clear();
+    std::vector<int> vFirstIds;
+    for (size_t i = 0; i < iBulkIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("insert", "bench_write", "");
+      nE_DataArray* pValues = new nE_DataArray();
+      vFirstIds.push_back(m_iNextId);
+      for (size_t j = 0; j < m_Options.m_iBulkSize; ++j) {
+        pValues->Push(m_Generator.CreateItem(m_iNextId++));
+      }
+      pQuery->Push("value", pValues);
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("insert_bulk", queries, m_Options.m_iBulkSize);
+
+    queries.clear();
+    for (size_t i = 0; i < iBulkIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("update_all", "bench_write", "");
+      nE_DataTable* pCriteria = pQuery->PushNewTable("criteria");
+      pCriteria->Push("min", vFirstIds[i]);
+      pCriteria->Push("max", vFirstIds[i] + (int)m_Options.m_iBulkSize - 1);
+      pQuery->PushNewTable("set")->Push("f0", (int)i);
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("update_all", queries, m_Options.m_iBulkSize);
+
+    queries.clear();
+    for (size_t i = 0; i < iBulkIterations; ++i) {
+      nE_DataTable* pQuery = CreateQuery("delete_all", "bench_write", "");
+      nE_DataTable* pCriteria = pQuery->PushNewTable("criteria");
+      pCriteria->Push("min", vFirstIds[i]);
+      pCriteria->Push("max", vFirstIds[i] + (int)m_Options.m_iBulkSize - 1);
+      queries.push_back(nE_DataTablePointer(pQuery));
+    }
+    ExecuteQueries("delete_all", queries, m_Options.m_iBulkSize);
+  }
+
+  void RunPersistenceCases() {
+    CollectionPointer pCollection = m_pDatabase->GetCollection(
+                                      m_sStoreCollection);
+    const size_t iIterations = std::max((size_t)1, m_Options.m_iScanIterations);
+
+    Run("save_writable", iIterations, m_Options.m_iRows, [&](size_t i) {
+      nE_DataTablePointer pItem(m_Generator.CreateItem(m_iNextId++));
+      pCollection->InsertItem(pItem.get());
+    }, [&](size_t i) {
+      m_pDatabase->SaveWritableCollections();
+    });
+
+    size_t iErrorCount = 0;
+    Run("load_writable", iIterations, m_Options.m_iRows, Operation(),
+    [&](size_t i) {
+      if (!m_pDatabase->LoadWritableCollections()) {
+        ++iErrorCount;
+      }
+    });
+    ReportErrors("load_writable", iErrorCount, iIterations,
+                 "a stored collection could not be read");
+
+    std::string sFilePath(m_Options.m_sDirectory + "/bench_readonly");
+    {
+      nE_DataPointer pData(m_Generator.CreateCollection("bench_readonly", 0,
+                           m_Options.m_iRows));
+      // The items go last, so the file is streamed like a real collection.
+      nE_DataTable options;
+      nE_DataTableIterator it = pData->AsTable()->Begin();
+      for (; it != pData->AsTable()->End(); ++it) {
+        if (it.Key() != "items") {
+          options.PushCopy(it.Key(), it.Value());
+        }
+      }
+      std::string sJson;
+      std::string sItems;
+      nE_DataUtils::SaveDataToJsonString(&options, sJson, false);
+      nE_DataUtils::SaveDataToJsonString(pData->AsTable()->Get("items"), sItems,
+                                         false);
+      sJson.resize(sJson.rfind('}'));
+      sJson += ",\"items\":" + sItems + "}";
+      std::ofstream file((sFilePath + ".json").c_str(),
+                         std::ios::out | std::ios::binary);
+      file << sJson;
+    }
+    Run("load_readonly", iIterations, m_Options.m_iRows, [&](size_t i) {
+      m_pDatabase->RemoveCollection("bench_readonly");
+    }, [&](size_t i) {
+      nE_DataTablePointer pOptions;
+      CollectionPointer pCollection = m_pDatabase->ReadCollection(sFilePath,
+                                      pOptions);
+      if (pCollection !=(CollectionPointer) NULL) {
+        m_pDatabase->AddReadonlyCollection(pCollection, pOptions.get());
+      } else {
+        m_pDatabase->CreateReadonlyCollection(
+          m_pDatabase->ReadCollectionData(sFilePath, false));
+      }
+    });
+    m_pDatabase->RemoveCollection("bench_readonly");
+    remove((sFilePath + ".json").c_str());
+  }
+
+  void Run(const std::string& sCase, size_t iIterations,
+           size_t iItemsPerOperation, Operation setup, Operation operation) {
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<double> vLatencies;
+    vLatencies.reserve(iIterations);
+    double fTotalSeconds = 0.0;
+    size_t iAllocationCount = 0;
+    for (size_t i = 0; i < iIterations; ++i) {
+      if (setup) {
+        setup(i);
+      }
+      const size_t iAllocationsBefore = g_iAllocationCount;
+      Clock::time_point start = Clock::now();
+      operation(i);
+      Clock::time_point end = Clock::now();
+      iAllocationCount += g_iAllocationCount - iAllocationsBefore;
+      double fSeconds = std::chrono::duration<double>(end - start).count();
+      fTotalSeconds += fSeconds;
+      vLatencies.push_back(fSeconds * 1e6);
+    }
+    Report(sCase, iItemsPerOperation, fTotalSeconds, iAllocationCount,
+           vLatencies);
+  }
+
+  void Report(const std::string& sCase, size_t iItemsPerOperation,
+              double fTotalSeconds, size_t iAllocationCount,
+              std::vector<double>& vLatencies) {
+    const size_t iCount = vLatencies.size();
+    std::sort(vLatencies.begin(), vLatencies.end());
+    printf("{\"case\": \"%s\", \"rows\": %u, \"fields\": %u, "
+           "\"distribution\": \"%s\", \"iterations\": %u, "
+           "\"items_per_op\": %u, \"ops_per_sec\": %.1f, "
+           "\"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, "
+           "\"max_us\": %.2f, \"allocations_per_op\": %.1f, "
+           "\"peak_rss_kb\": %u}\n",
+           sCase.c_str(), (unsigned)m_Options.m_iRows,
+           (unsigned)m_Options.m_iFields, m_Options.m_sDistribution.c_str(),
+           (unsigned)iCount, (unsigned)iItemsPerOperation,
+           (fTotalSeconds > 0.0 ? iCount / fTotalSeconds : 0.0),
+           Percentile(vLatencies, 0.50), Percentile(vLatencies, 0.90),
+           Percentile(vLatencies, 0.99), Percentile(vLatencies, 1.0),
+           (iCount > 0 ? (double)iAllocationCount / iCount : 0.0),
+           (unsigned)GetPeakResidentSetKb());
+    fflush(stdout);
+  }
+
+  static double Percentile(const std::vector<double>& vSorted,
+                           double fPercentile) {
+    if (vSorted.empty()) {
+      return 0.0;
+    }
+    size_t iIndex = (size_t)(fPercentile * vSorted.size());
+    return vSorted[std::min(iIndex, vSorted.size() - 1)];
+  }
+
+  static size_t GetPeakResidentSetKb() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+      return counters.PeakWorkingSetSize / 1024;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+      return 0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+  }
+
+ private:
+  const BenchmarkOptions&            m_Options;
+  CollectionGenerator                m_Generator;
+  std::shared_ptr<BenchmarkDatabase> m_pDatabase;
+  int                                m_iNextId;
+  std::string                        m_sStoreCollection;
+  bool                               m_bHasFailed;
+};
+
+bool ParseOption(const char* sArgument, const char* sName, std::string& sValue) {
+  const size_t iNameLength = strlen(sName);
+  if (strncmp(sArgument, sName, iNameLength) == 0 &&
+      sArgument[iNameLength] == '=') {
+    sValue = sArgument + iNameLength + 1;
+    return true;
+  }
+  return false;
+}
+
+bool ParseOptions(int argc, char** argv, BenchmarkOptions& options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string sValue;
+    if (ParseOption(argv[i], "--rows", sValue)) {
+      options.m_iRows = std::max(1, atoi(sValue.c_str()));
+    } else if (ParseOption(argv[i], "--fields", sValue)) {
+      options.m_iFields = std::max(0, atoi(sValue.c_str()));
+    } else if (ParseOption(argv[i], "--iterations", sValue)) {
+      options.m_iIterations = std::max(1, atoi(sValue.c_str()));
+    } else if (ParseOption(argv[i], "--scan-iterations", sValue)) {
+      options.m_iScanIterations = std::max(1, atoi(sValue.c_str()));
+    } else if (ParseOption(argv[i], "--bulk", sValue)) {
+      options.m_iBulkSize = std::max(1, atoi(sValue.c_str()));
+    } else if (ParseOption(argv[i], "--range", sValue)) {
+      options.m_iRange = std::max(0, atoi(sValue.c_str()));
+    } else if (ParseOption(argv[i], "--miss-ratio", sValue)) {
+      options.m_fMissRatio = atof(sValue.c_str());
+    } else if (ParseOption(argv[i], "--distribution", sValue)) {
+      options.m_sDistribution = sValue;
+    } else if (ParseOption(argv[i], "--seed", sValue)) {
+      options.m_iSeed = (unsigned)atoi(sValue.c_str());
+    } else if (ParseOption(argv[i], "--directory", sValue)) {
+      options.m_sDirectory = sValue;
+    } else if (strcmp(argv[i], "--key-filters") == 0) {
+      options.m_bUseKeyFilters = true;
+    } else if (strcmp(argv[i], "--columnar") == 0) {
+      options.m_bIsColumnar = true;
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+}
+
+int main(int argc, char** argv) {
+  parts::db::BenchmarkOptions options;
+  if (!parts::db::ParseOptions(argc, argv, options)) {
+    return 1;
+  }
+  parts::db::Benchmark benchmark(options);
+  return (benchmark.RunAll() ? 0 : 1);
+}
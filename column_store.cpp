@@ -0,0 +1,254 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#include "parts/include.h"
+#include "column_store.h"
+#include "query.h"
+#include <algorithm>
+#include <math.h>
+
+namespace parts {
+namespace db {
+
+namespace {
+
+const size_t SCAN_BLOCK_SIZE = 1024;
+
+}
+
+ColumnStore::Column::Column()
+  : m_eType(Column_Empty) {}
+
+ColumnStore::ColumnStore() {}
+
+void ColumnStore::Build(const nE_DataArray* pItems) {
+  m_vRows.clear();
+  m_Columns.clear();
+  for (size_t i = 0; i < pItems->Size(); ++i) {
+    const nE_DataTable* pItem = pItems->Get(i)->AsTable();
+    if (pItem != NULL) {
+      m_vRows.push_back(pItem);
+    }
+  }
+}
+
+size_t ColumnStore::GetRowCount() const {
+  return m_vRows.size();
+}
+
+const nE_DataTable* ColumnStore::GetRow(size_t iRow) const {
+  return m_vRows[iRow];
+}
+
+ColumnStore::ColumnType ColumnStore::GetColumnType(const std::string& sField)
+const {
+  return GetColumn(sField).m_eType;
+}
+
+bool ColumnStore::SelectRange(const std::string& sField, const nE_Data* pMin,
+                              const nE_Data* pMax, size_t iLimit,
+                              RowVector& rows) const {
+  const Column& column = GetColumn(sField);
+  if (column.m_eType == Column_Empty) {
+    return true;
+  }
+
+  const size_t iCount = m_vRows.size();
+  double fMin = 0.0;
+  double fMax = 0.0;
+  switch (column.m_eType) {
+    case Column_Int:
+      if (!GetNumber(pMin, fMin) || !GetNumber(pMax, fMax)) {
+        return false;
+      }
+      fMin = std::max(ceil(fMin), (double)INT_MIN);
+      fMax = std::min(floor(fMax), (double)INT_MAX);
+      if (fMin <= fMax) {
+        SelectBetween(&column.m_vInts[0], &column.m_vPresent[0], iCount,
+                      (int)fMin, (int)fMax, iLimit, rows);
+      }
+      return true;
+
+    case Column_Float:
+      if (!GetNumber(pMin, fMin) || !GetNumber(pMax, fMax)) {
+        return false;
+      }
+      SelectBetween(&column.m_vFloats[0], &column.m_vPresent[0], iCount,
+                    fMin, fMax, iLimit, rows);
+      return true;
+
+    case Column_String: {
+      if (!IsString(pMin) || !IsString(pMax)) {
+        return false;
+      }
+      const std::vector<std::string>& dictionary = column.m_vDictionary;
+      int iMinCode = (int)(std::lower_bound(dictionary.begin(), dictionary.end(),
+                                            pMin->AsString()) - dictionary.begin());
+      int iMaxCode = (int)(std::upper_bound(dictionary.begin(), dictionary.end(),
+                                            pMax->AsString()) - dictionary.begin()) - 1;
+      if (iMinCode <= iMaxCode) {
+        SelectBetween(&column.m_vCodes[0], &column.m_vPresent[0], iCount,
+                      iMinCode, iMaxCode, iLimit, rows);
+      }
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
+
+bool ColumnStore::GatherNumbers(const std::string& sField,
+                                const size_t* pRows, size_t iCount,
+                                double* pValues, uint8_t* pPresent) const {
+  const Column& column = GetColumn(sField);
+  if (column.m_eType == Column_Empty) {
+    std::fill(pPresent, pPresent + iCount, 0);
+    return true;
+  }
+
+  if (column.m_eType == Column_Int) {
+    for (size_t i = 0; i < iCount; ++i) {
+      pValues[i] = column.m_vInts[pRows[i]];
+      pPresent[i] = column.m_vPresent[pRows[i]];
+    }
+    return true;
+  } else if (column.m_eType == Column_Float) {
+    for (size_t i = 0; i < iCount; ++i) {
+      pValues[i] = column.m_vFloats[pRows[i]];
+      pPresent[i] = column.m_vPresent[pRows[i]];
+    }
+    return true;
+  }
+  return false;
+}
+
+ColumnStore::ColumnType ColumnStore::GetValueType(const nE_Data* pValue) {
+  switch (pValue->GetType()) {
+    case nE_Data::Data_Int:
+      return Column_Int;
+    case nE_Data::Data_Float:
+      return Column_Float;
+    case nE_Data::Data_String:
+      return Column_String;
+    default:
+      return Column_Mixed;
+  }
+}
+
+const ColumnStore::Column& ColumnStore::GetColumn(const std::string& sField)
+const {
+  ColumnMap::iterator it = m_Columns.find(sField);
+  if (it == m_Columns.end()) {
+    it = m_Columns.insert(ColumnMap::value_type(sField, Column())).first;
+    BuildColumn(sField, it->second);
+  }
+  return it->second;
+}
+
+void ColumnStore::BuildColumn(const std::string& sField, Column& column)
+const {
+  const size_t iCount = m_vRows.size();
+
+  ColumnType eType = Column_Empty;
+  for (size_t i = 0; i < iCount && eType != Column_Mixed; ++i) {
+    const nE_Data* pValue = m_vRows[i]->Get(sField);
+    if (pValue == NULL) {
+      continue;
+    }
+    ColumnType eValueType = GetValueType(pValue);
+    if (eType == Column_Empty || eType == eValueType) {
+      eType = eValueType;
+    } else if ((eType == Column_Int && eValueType == Column_Float) ||
+               (eType == Column_Float && eValueType == Column_Int)) {
+      eType = Column_Float;
+    } else {
+      eType = Column_Mixed;
+    }
+  }
+
+  column.m_eType = eType;
+  if (eType == Column_Empty || eType == Column_Mixed) {
+    return;
+  }
+
+  column.m_vPresent.resize(iCount, 0);
+  if (eType == Column_Int) {
+    column.m_vInts.resize(iCount, 0);
+  } else if (eType == Column_Float) {
+    column.m_vFloats.resize(iCount, 0.0);
+  } else {
+    column.m_vCodes.resize(iCount, -1);
+    for (size_t i = 0; i < iCount; ++i) {
+      const nE_Data* pValue = m_vRows[i]->Get(sField);
+      if (pValue != NULL) {
+        column.m_vDictionary.push_back(pValue->AsString());
+      }
+    }
+    std::sort(column.m_vDictionary.begin(), column.m_vDictionary.end());
+    column.m_vDictionary.erase(std::unique(column.m_vDictionary.begin(),
+                                           column.m_vDictionary.end()),
+                               column.m_vDictionary.end());
+  }
+
+  for (size_t i = 0; i < iCount; ++i) {
+    const nE_Data* pValue = m_vRows[i]->Get(sField);
+    if (pValue == NULL) {
+      continue;
+    }
+    column.m_vPresent[i] = 1;
+    if (eType == Column_Int) {
+      column.m_vInts[i] = pValue->AsInt();
+    } else if (eType == Column_Float) {
+      GetNumber(pValue, column.m_vFloats[i]);
+    } else {
+      column.m_vCodes[i] = (int)(std::lower_bound(column.m_vDictionary.begin(),
+                                                  column.m_vDictionary.end(),
+                                                  pValue->AsString()) -
+                                 column.m_vDictionary.begin());
+    }
+  }
+}
+
+bool ColumnStore::GetNumber(const nE_Data* pValue, double& fValue) {
+  if (pValue == NULL) {
+    return false;
+  } else if (pValue->GetType() == nE_Data::Data_Int) {
+    fValue = pValue->AsInt();
+    return true;
+  } else if (pValue->GetType() == nE_Data::Data_Float) {
+    fValue = pValue->AsFloat();
+    return true;
+  }
+  return false;
+}
+
+template <typename T>
+void ColumnStore::SelectBetween(const T* pValues, const uint8_t* pPresent,
+                                size_t iCount, T min, T max, size_t iLimit,
+                                RowVector& rows) {
+  uint8_t mask[SCAN_BLOCK_SIZE];
+  for (size_t iBlock = 0; iBlock < iCount && rows.size() < iLimit;
+       iBlock += SCAN_BLOCK_SIZE) {
+    const size_t iBlockSize = std::min(SCAN_BLOCK_SIZE, iCount - iBlock);
+    const T* pBlockValues = pValues + iBlock;
+    const uint8_t* pBlockPresent = pPresent + iBlock;
+    // Branch-free so the compiler can vectorize the comparison.
+    for (size_t i = 0; i < iBlockSize; ++i) {
+      mask[i] = (uint8_t)((pBlockValues[i] >= min) & (pBlockValues[i] <= max) &
+                          pBlockPresent[i]);
+    }
+    for (size_t i = 0; i < iBlockSize && rows.size() < iLimit; ++i) {
+      if (mask[i]) {
+        rows.push_back(iBlock + i);
+      }
+    }
+  }
+}
+
+}
+}
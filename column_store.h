@@ -0,0 +1,81 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#ifndef COLUMN_STORE_H_6B1D2E07_3C59_4A8E_9F14_0D7A5C2B8E31
+#define COLUMN_STORE_H_6B1D2E07_3C59_4A8E_9F14_0D7A5C2B8E31
+
+#include "data_reference.h"
+
+namespace parts {
+namespace db {
+
+// Columnar copy of a readonly collection. A top-level field of the items is
+// kept in a typed contiguous vector once a query first reads it, so only the
+// fields that are filtered on take extra memory; strings are
+// dictionary-encoded with an ordered dictionary, so string ranges are
+// scanned as integer ranges. Rows are only referenced by id and resolved to
+// the item tables on demand.
+class ColumnStore {
+ public:
+  typedef std::vector<size_t> RowVector;
+
+  enum ColumnType {
+    Column_Empty,
+    Column_Int,
+    Column_Float,
+    Column_String,
+    Column_Mixed
+  };
+
+ public:
+  ColumnStore();
+  void                Build(const nE_DataArray* pItems);
+  size_t              GetRowCount() const;
+  const nE_DataTable* GetRow(size_t iRow) const;
+  ColumnType          GetColumnType(const std::string& sField) const;
+  bool                SelectRange(const std::string& sField, const nE_Data* pMin,
+                                  const nE_Data* pMax, size_t iLimit,
+                                  RowVector& rows) const;
+  bool                GatherNumbers(const std::string& sField,
+                                    const size_t* pRows, size_t iCount,
+                                    double* pValues, uint8_t* pPresent) const;
+
+ private:
+  struct Column {
+    ColumnType               m_eType;
+    std::vector<uint8_t>     m_vPresent;
+    std::vector<int>         m_vInts;
+    std::vector<double>      m_vFloats;
+    std::vector<int>         m_vCodes;
+    std::vector<std::string> m_vDictionary;
+
+    Column();
+  };
+
+  typedef std::map<std::string, Column> ColumnMap;
+
+ private:
+  static ColumnType GetValueType(const nE_Data* pValue);
+  const Column&     GetColumn(const std::string& sField) const;
+  void              BuildColumn(const std::string& sField, Column& column) const;
+  static bool       GetNumber(const nE_Data* pValue, double& fValue);
+  template <typename T>
+  static void       SelectBetween(const T* pValues, const uint8_t* pPresent,
+                                  size_t iCount, T min, T max, size_t iLimit,
+                                  RowVector& rows);
+
+ private:
+  std::vector<const nE_DataTable*> m_vRows;
+  mutable ColumnMap                m_Columns;
+};
+
+typedef std::shared_ptr<ColumnStore> ColumnStorePointer;
+
+}
+}
+
+#endif//COLUMN_STORE_H_6B1D2E07_3C59_4A8E_9F14_0D7A5C2B8E31
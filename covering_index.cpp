@@ -0,0 +1,136 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#include "parts/include.h"
+#include "covering_index.h"
+#include "collection.h"
+#include <ctype.h>
+
+namespace parts {
+namespace db {
+
+namespace {
+
+bool IsIdentifierChar(char cValue) {
+  return (isalnum((unsigned char)cValue) || cValue == '_' || cValue == '.');
+}
+
+}
+
+CoveringIndex::CoveringIndex(const std::string& sIndexField,
+                             const nE_StringVector& vFields)
+  : m_pIndex(NULL),
+    m_vFields(vFields) {
+  m_vFields.push_back(sIndexField);
+  m_vFields.push_back(Collection::DEFAULT_INDEX_NAME);
+}
+
+void CoveringIndex::Reset(const CollectionIndex* pIndex) {
+  m_pIndex = pIndex;
+  m_Entries.clear();
+}
+
+bool CoveringIndex::IsBuiltFor(const CollectionIndex* pIndex) const {
+  return (m_pIndex == pIndex);
+}
+
+void CoveringIndex::Invalidate() {
+  m_pIndex = NULL;
+  m_Entries.clear();
+}
+
+void CoveringIndex::Remove(const nE_Data* pItem) {
+  m_Entries.erase(pItem);
+}
+
+bool CoveringIndex::Covers(const nE_Data* pResult,
+                           const std::string& sAlias) const {
+  if (pResult == NULL) {
+    return false;
+  }
+  switch (pResult->GetType()) {
+    case nE_Data::Data_String:
+      return CoversExpression(pResult->AsString(), sAlias);
+    case nE_Data::Data_Table: {
+      const nE_DataTable* pTable = pResult->AsTable();
+      nE_DataTableConstIterator it = pTable->Begin();
+      for (; it != pTable->End(); ++it) {
+        if (!Covers(it.Value(), sAlias)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case nE_Data::Data_Array: {
+      const nE_DataArray* pArray = pResult->AsArray();
+      for (size_t i = 0; i < pArray->Size(); ++i) {
+        if (!Covers(pArray->Get(i), sAlias)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    default:
+      return true;
+  }
+}
+
+const nE_DataTable* CoveringIndex::GetEntry(const nE_DataTable* pItem) {
+  nE_DataTablePointer& pEntry = m_Entries[pItem];
+  if (pEntry ==(nE_DataTablePointer) NULL) {
+    pEntry.reset(new nE_DataTable());
+    for (size_t i = 0; i < m_vFields.size(); ++i) {
+      const nE_Data* pValue = pItem->Get(m_vFields[i]);
+      if (pValue != NULL && !pEntry->IsExist(m_vFields[i])) {
+        pEntry->PushCopy(m_vFields[i], pValue);
+      }
+    }
+  }
+  return pEntry.get();
+}
+
+bool CoveringIndex::CoversExpression(const std::string& sExpression,
+                                     const std::string& sAlias) const {
+  // Every identifier of the expression must name a covered field, either
+  // directly or through the alias. Anything else keeps the whole item.
+  const std::string sAliasPrefix(sAlias + ".");
+  size_t i = 0;
+  while (i < sExpression.size()) {
+    if (!IsIdentifierChar(sExpression[i])) {
+      ++i;
+      continue;
+    }
+    size_t iEnd = i;
+    while (iEnd < sExpression.size() && IsIdentifierChar(sExpression[iEnd])) {
+      ++iEnd;
+    }
+    std::string sToken(sExpression, i, iEnd - i);
+    i = iEnd;
+    if (isdigit((unsigned char)sToken[0])) {
+      continue;
+    }
+    if (!sAlias.empty()) {
+      if (sToken == sAlias) {
+        return false;
+      } else if (sToken.compare(0, sAliasPrefix.size(), sAliasPrefix) == 0) {
+        sToken.erase(0, sAliasPrefix.size());
+      }
+    }
+    if (!IsCoveredField(sToken.substr(0, sToken.find('.')))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CoveringIndex::IsCoveredField(const std::string& sField) const {
+  return (std::find(m_vFields.begin(), m_vFields.end(), sField) !=
+          m_vFields.end());
+}
+
+}
+}
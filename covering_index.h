@@ -0,0 +1,52 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#ifndef COVERING_INDEX_H_58C2E9A1_B7F4_4D06_93AE_E16D0B4C72F3
+#define COVERING_INDEX_H_58C2E9A1_B7F4_4D06_93AE_E16D0B4C72F3
+
+#include "data_reference.h"
+#include <unordered_map>
+
+namespace parts {
+namespace db {
+
+// Narrow copies of the items of one index holding only the index key, the
+// primary key and the fields listed in the collection's 'include' option.
+// A query result that only references these fields is calculated from the
+// narrow entry instead of the whole item table. Entries are made the first
+// time an item is read and dropped when the item is changed or deleted.
+class CoveringIndex {
+ public:
+  CoveringIndex(const std::string& sIndexField, const nE_StringVector& vFields);
+  void                Reset(const CollectionIndex* pIndex);
+  bool                IsBuiltFor(const CollectionIndex* pIndex) const;
+  void                Invalidate();
+  void                Remove(const nE_Data* pItem);
+  bool                Covers(const nE_Data* pResult,
+                             const std::string& sAlias) const;
+  const nE_DataTable* GetEntry(const nE_DataTable* pItem);
+
+ private:
+  typedef std::unordered_map<const nE_Data*, nE_DataTablePointer> EntryMap;
+
+ private:
+  bool CoversExpression(const std::string& sExpression,
+                        const std::string& sAlias) const;
+  bool IsCoveredField(const std::string& sField) const;
+
+ private:
+  const CollectionIndex* m_pIndex;
+  nE_StringVector        m_vFields;
+  EntryMap               m_Entries;
+};
+
+typedef std::shared_ptr<CoveringIndex> CoveringIndexPointer;
+
+}
+}
+
+#endif//COVERING_INDEX_H_58C2E9A1_B7F4_4D06_93AE_E16D0B4C72F3
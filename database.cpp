@@ -11,28 +11,252 @@
 #include "query_context.h"
 #include "query_builder.h"
 #include "query.h"
+#include "json_reader.h"
 #include "parts/storage/storage.h"
 #include "parts/version/version.h"
 #include "parts/net/net.h"
 #include <memory.h>
+#include <fstream>
+#include <sstream>
+#include <ctype.h>
 
 namespace parts {
 namespace db {
 
+namespace {
+
+const ReadonlyCollectionIndexPointer s_pNullIndex;
+
+// Fills a collection straight from the item events of a collection file or
+// of the stored items of a writable collection. A collection file sets up
+// the collection from its options; with bIsRefill the items go into the
+// collection as it is and any options are ignored.
+class CollectionStreamHandler : public JsonItemHandler {
+ public:
+  CollectionStreamHandler(CollectionPointer pCollection, bool bIsRefill)
+    : m_pCollection(pCollection),
+      m_bIsRefill(bIsRefill) {}
+
+  nE_DataTablePointer GetOptions() const {
+    return m_pOptions;
+  }
+
+ protected:
+  virtual bool OnOptions(const nE_DataTable* pOptions) {
+    if (m_bIsRefill) {
+      return true;
+    }
+    m_pOptions.reset(new nE_DataTable());
+    nE_DataTableConstIterator it = pOptions->Begin();
+    for (; it != pOptions->End(); ++it) {
+      if (it.Key() != "items") {
+        m_pOptions->PushCopy(it.Key(), it.Value());
+      }
+    }
+    nE_DataPointer pData(m_pOptions->Clone());
+    pData->AsTable()->PushNewArray("items");
+    m_pCollection->SetCollectionData(pData);
+    return true;
+  }
+
+  virtual bool OnItem(const nE_DataTable* pItem) {
+    m_pCollection->InsertItem(pItem);
+    return true;
+  }
+
+ private:
+  CollectionPointer   m_pCollection;
+  bool                m_bIsRefill;
+  nE_DataTablePointer m_pOptions;
+};
+
+// Only a document whose "items" come last is streamed. When the document
+// does not even end with an array, this is told from its tail before any
+// item is read.
+bool MayEndWithItems(std::istream& stream) {
+  const std::streampos iStart = stream.tellg();
+  if (iStart == std::streampos(-1)) {
+    return true;
+  }
+  stream.seekg(0, std::ios::end);
+  const std::streamoff iTailSize = std::min<std::streamoff>(
+                                     stream.tellg() - iStart, 256);
+  std::string sTail((size_t)iTailSize, ' ');
+  stream.seekg(-iTailSize, std::ios::end);
+  stream.read(&sTail[0], iTailSize);
+  stream.clear();
+  stream.seekg(iStart);
+
+  size_t i = sTail.find_last_not_of(" \t\r\n");
+  if (i == std::string::npos || sTail[i] != '}') {
+    return true;
+  }
+  i = sTail.find_last_not_of(" \t\r\n", (i > 0 ? i - 1 : 0));
+  return (i != std::string::npos && sTail[i] == ']');
+}
+
+// Finds the top-level "name" of a collection file without building a data
+// tree, so lazily loaded collections can be registered by name.
+bool ReadCollectionName(const std::string& sFilePath, std::string& sName) {
+  std::ifstream file(sFilePath.c_str(), std::ios::in | std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  int iDepth = 0;
+  bool bIsInString = false;
+  bool bIsEscaped = false;
+  bool bIsNameValue = false;
+  std::string sString;
+  std::string sKey;
+  char buffer[4096];
+  while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+    const std::streamsize iCount = file.gcount();
+    for (std::streamsize i = 0; i < iCount; ++i) {
+      const char cValue = buffer[i];
+      if (bIsInString) {
+        if (bIsEscaped) {
+          sString += cValue;
+          bIsEscaped = false;
+        } else if (cValue == '\\') {
+          bIsEscaped = true;
+        } else if (cValue == '"') {
+          bIsInString = false;
+          if (bIsNameValue) {
+            sName = sString;
+            return true;
+          } else if (iDepth == 1) {
+            sKey = sString;
+          }
+        } else {
+          sString += cValue;
+        }
+        continue;
+      }
+      switch (cValue) {
+        case '"':
+          bIsInString = true;
+          sString.clear();
+          break;
+        case '{':
+        case '[':
+          ++iDepth;
+          bIsNameValue = false;
+          break;
+        case '}':
+        case ']':
+          --iDepth;
+          break;
+        case ':':
+          bIsNameValue = (iDepth == 1 && sKey == "name");
+          sKey.clear();
+          break;
+        case ',':
+          bIsNameValue = false;
+          sKey.clear();
+          break;
+        default:
+          if (!isspace((unsigned char)cValue)) {
+            bIsNameValue = false;
+          }
+          break;
+      }
+    }
+  }
+  return false;
+}
+
+const size_t DUMP_CHUNK_SIZE = 256;
+const size_t DUMP_READ_SIZE = 4096;
+
+// A dump record is its byte length on one line followed by its JSON text.
+void WriteDumpRecord(std::ostream& stream, const std::string& sRecord) {
+  stream << sRecord.size() << '\n';
+  stream.write(sRecord.data(), sRecord.size());
+  stream << '\n';
+}
+
+// The record grows only as its bytes arrive, so a damaged length fails at the
+// end of the stream instead of allocating it up front.
+bool ReadDumpRecord(std::istream& stream, std::string& sRecord) {
+  size_t iSize = 0;
+  if (!(stream >> iSize) || stream.get() != '\n') {
+    return false;
+  }
+  sRecord.clear();
+  char buffer[DUMP_READ_SIZE];
+  while (sRecord.size() < iSize) {
+    const size_t iCount = std::min(DUMP_READ_SIZE, iSize - sRecord.size());
+    if (!stream.read(buffer, iCount)) {
+      return false;
+    }
+    sRecord.append(buffer, iCount);
+  }
+  return (stream.get() == '\n');
+}
+
+size_t EstimateDataSize(const nE_Data* pData) {
+  const size_t NODE_SIZE = 32;
+  if (pData == NULL) {
+    return 0;
+  }
+  size_t iSize = NODE_SIZE;
+  switch (pData->GetType()) {
+    case nE_Data::Data_String:
+      iSize += pData->AsString().size();
+      break;
+    case nE_Data::Data_Table: {
+      nE_DataTableConstIterator it = pData->AsTable()->Begin();
+      for (; it != pData->AsTable()->End(); ++it) {
+        iSize += it.Key().size() + EstimateDataSize(it.Value());
+      }
+      break;
+    }
+    case nE_Data::Data_Array:
+      for (size_t i = 0; i < pData->AsArray()->Size(); ++i) {
+        iSize += EstimateDataSize(pData->AsArray()->Get(i));
+      }
+      break;
+    default:
+      break;
+  }
+  return iSize;
+}
+
+}
+
 Database* Database::s_pInstance = NULL;
 
+Database::LazyCollection::LazyCollection()
+  : m_bIsLoaded(false)
+  , m_iSize(0)
+  , m_iCollectionHandle(INVALID_HANDLE) {}
+
 Database::Database(const nE_DataTable* pOptionTable)
   : m_iNextTemporaryCollection(0)
   , m_bIsCorrupted(false)
-  , m_bIsReady(false) {
+  , m_bIsReady(false)
+  , m_bIsColumnar(false)
+  , m_bUseKeyFilters(false)
+  , m_bIsStreamed(true)
+  , m_bIsLazy(false)
+  , m_bIsPrefetched(false)
+  , m_iLazyMemoryBudget(0)
+  , m_iLazyUseTick(0)
+  , m_bStopPrefetch(false) {
   InitializeListener();
 
+  m_bUseKeyFilters = nE_DataUtils::GetAsBool(pOptionTable, "key_filters", false);
+  m_QueryCache.SetCapacity((size_t)std::max(0,
+                           nE_DataUtils::GetAsInt(pOptionTable, "query_cache_size", 0)));
+
   InitializeSystemCollections();
   InitializeReadonlyCollections(pOptionTable);
   InitializeWritableCollections(pOptionTable);
 }
 
 Database::~Database(void) {
+  StopPrefetch();
 }
 
 void Database::Initialize(const nE_DataTable* pOptionTable) {
@@ -66,24 +290,20 @@ void Database::Repair() {
 
 QueryResultPointer Database::ExecuteQuery(const std::string& sQueryString) {
   nE_DataPointer pQuery(nE_DataUtils::LoadDataFromJsonString(sQueryString));
-  QueryContext queryContext;
-  return ExecuteQueryInternal(pQuery.get(), queryContext);
+  return ExecuteCachedQuery(pQuery.get());
 }
 
 QueryResultPointer Database::ExecuteQuery(const nE_DataTable& queryTable) {
-  QueryContext queryContext;
-  return ExecuteQueryInternal(&queryTable, queryContext);
+  return ExecuteCachedQuery(&queryTable);
 }
 
 QueryResultPointer Database::ExecuteQuery(const nE_DataTable* pQueryTable) {
-  QueryContext queryContext;
-  return ExecuteQueryInternal(pQueryTable, queryContext);
+  return ExecuteCachedQuery(pQueryTable);
 }
 
 QueryResultPointer Database::ExecuteQuery(const nE_DataTablePointer
     pQueryTable) {
-  QueryContext queryContext;
-  return ExecuteQueryInternal(pQueryTable.get(), queryContext);
+  return ExecuteCachedQuery(pQueryTable.get());
 }
 
 bool Database::ExecuteQueryArray(const nE_DataArray* pQueryArray,
@@ -104,9 +324,7 @@ void Database::ScriptExecuteQuery(nE_DataArray* pArgs, void* pUserBoundData,
                                   nE_DataArray* pResult) {
   Database* pThis = (Database*) pUserBoundData;
   nE_Data* pQuestTable = pArgs->Get(0);
-  QueryContext queryContext;
-  QueryResultPointer pQueryResult = pThis->ExecuteQueryInternal(pQuestTable,
-                                    queryContext);
+  QueryResultPointer pQueryResult = pThis->ExecuteCachedQuery(pQuestTable);
   nE_DataTable* pResultTable = pResult->PushNewTable();
   if (!pQueryResult->HasErrors()) {
     pResultTable->Push("status", 1);
@@ -150,6 +368,40 @@ nE_DataPointer Database::ReadCollectionData(const std::string&
   return nE_DataPointer(pData);
 }
 
+CollectionPointer Database::ReadCollection(const std::string&
+    sCollectionFilePath, nE_DataTablePointer& pOptions) {
+  // Only plain collection files whose items come last are streamed; any
+  // other file, and every file when streaming is off for targets that keep
+  // their files in a packed file system, is left to ReadCollectionData.
+  if (!m_bIsStreamed) {
+    return CollectionPointer();
+  }
+  std::ifstream file((sCollectionFilePath + ".json").c_str(),
+                     std::ios::in | std::ios::binary);
+  if (!file) {
+    return CollectionPointer();
+  }
+  return ReadCollection(file, pOptions);
+}
+
+CollectionPointer Database::ReadCollection(std::istream& stream,
+    nE_DataTablePointer& pOptions) {
+  if (!MayEndWithItems(stream)) {
+    return CollectionPointer();
+  }
+  CollectionPointer pCollection(new Collection());
+  pCollection->SetReadOnly(false);
+  CollectionStreamHandler handler(pCollection, false);
+  JsonReader reader(stream);
+  if (!reader.Read(handler) || !handler.HasItems() || handler.IsItemArray()) {
+    return CollectionPointer();
+  }
+  pCollection->SetReadOnly(true);
+  pCollection->ResetChanges();
+  pOptions = handler.GetOptions();
+  return pCollection;
+}
+
 void Database::InitializeReadonlyCollections(const nE_DataTable*
     pOptionTable) {
   std::string sDirectory(
@@ -158,9 +410,23 @@ void Database::InitializeReadonlyCollections(const nE_DataTable*
   const nE_DataArray* pCollectionFileNames =
     nE_DataUtils::GetAsArrayNotNull(pOptionTable, "collections");
 
+  m_bIsColumnar = nE_DataUtils::GetAsBool(pOptionTable, "columnar", false);
+  m_bIsStreamed = nE_DataUtils::GetAsBool(pOptionTable, "streaming", true);
+  m_bIsLazy = nE_DataUtils::GetAsBool(pOptionTable, "lazy", false);
+  m_bIsPrefetched = nE_DataUtils::GetAsBool(pOptionTable, "lazy_prefetch",
+                    false);
+  m_iLazyMemoryBudget = (size_t)std::max(0,
+                        nE_DataUtils::GetAsInt(pOptionTable, "lazy_memory_budget", 0));
+
   if (pOptionTable != &m_ReadonlyCollectionOptions) {
     m_ReadonlyCollectionOptions.Push("directory", sDirectory);
     m_ReadonlyCollectionOptions.PushCopy("collections", pCollectionFileNames);
+    m_ReadonlyCollectionOptions.Push("columnar", m_bIsColumnar);
+    m_ReadonlyCollectionOptions.Push("streaming", m_bIsStreamed);
+    m_ReadonlyCollectionOptions.Push("lazy", m_bIsLazy);
+    m_ReadonlyCollectionOptions.Push("lazy_prefetch", m_bIsPrefetched);
+    m_ReadonlyCollectionOptions.Push("lazy_memory_budget",
+                                     (int)m_iLazyMemoryBudget);
   }
 }
 
@@ -207,42 +473,248 @@ void Database::RegisterBaseReadonlyCollections(const nE_DataTable*
 }
 
 void Database::LoadReadonlyCollections() {
+  StopPrefetch();
+  m_LazyCollections.clear();
+
+  LazyCollectionMap lazyCollections;
   for (auto it = m_vReadonlyCollections.begin();
        it != m_vReadonlyCollections.end(); ++it) {
+    std::string sCollectionName;
+    if (m_bIsLazy && m_bIsStreamed &&
+        ReadCollectionName(*it + ".json", sCollectionName)) {
+      lazyCollections[sCollectionName].m_vFiles.push_back(*it);
+      continue;
+    }
+    nE_DataTablePointer pOptions;
+    CollectionPointer pCollection = ReadCollection(*it, pOptions);
+    if (pCollection !=(CollectionPointer) NULL) {
+      AddReadonlyCollection(pCollection, pOptions.get());
+      continue;
+    }
     nE_DataPointer pData(ReadCollectionData(*it, false));
     if (pData != (nE_DataPointer)NULL) {
       CreateReadonlyCollection(pData);
     }
   }
+  m_LazyCollections.swap(lazyCollections);
+  LazyCollectionMap::iterator itLazy = m_LazyCollections.begin();
+  for (; itLazy != m_LazyCollections.end(); ++itLazy) {
+    itLazy->second.m_iCollectionHandle = GetCollectionHandle(itLazy->first);
+  }
+
+  if (m_bIsPrefetched) {
+    StartPrefetch();
+  }
+}
+
+// Called only when the collection is not loaded.
+void Database::TouchLazyCollection(const std::string& sCollectionName) {
+  LazyCollectionMap::iterator it = m_LazyCollections.find(sCollectionName);
+  if (it != m_LazyCollections.end() && !it->second.m_bIsLoaded) {
+    LoadLazyCollection(sCollectionName, it->second);
+  }
+}
+
+void Database::LoadLazyCollection(const std::string& sCollectionName,
+                                  LazyCollection& lazyCollection) {
+  lazyCollection.m_bIsLoaded = true;
+  lazyCollection.m_iSize = 0;
+  for (auto it = lazyCollection.m_vFiles.begin();
+       it != lazyCollection.m_vFiles.end(); ++it) {
+    std::string sText;
+    bool bIsPrefetched = false;
+    {
+      std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+      m_PrefetchQueue.erase(*it);
+      PrefetchedFileMap::iterator itPrefetched = m_PrefetchedFiles.find(*it);
+      if (itPrefetched != m_PrefetchedFiles.end()) {
+        sText.swap(itPrefetched->second);
+        m_PrefetchedFiles.erase(itPrefetched);
+        bIsPrefetched = true;
+      }
+    }
+    nE_DataTablePointer pOptions;
+    CollectionPointer pCollection;
+    nE_DataPointer pData;
+    if (bIsPrefetched) {
+      std::istringstream stream(sText);
+      pCollection = ReadCollection(stream, pOptions);
+      if (pCollection ==(CollectionPointer) NULL) {
+        pData.reset(nE_DataUtils::LoadDataFromJsonString(sText));
+      }
+    } else {
+      pCollection = ReadCollection(*it, pOptions);
+      if (pCollection ==(CollectionPointer) NULL) {
+        pData = ReadCollectionData(*it, false);
+      }
+    }
+    if (pCollection !=(CollectionPointer) NULL) {
+      lazyCollection.m_iSize += EstimateDataSize(pCollection->GetItems());
+      AddReadonlyCollection(pCollection, pOptions.get());
+    } else if (pData != (nE_DataPointer)NULL) {
+      lazyCollection.m_iSize += EstimateDataSize(pData.get());
+      CreateReadonlyCollection(pData);
+    }
+  }
+}
+
+void Database::UnloadLazyCollection(const std::string& sCollectionName,
+                                    LazyCollection& lazyCollection) {
+  m_Collections.erase(sCollectionName);
+  UpdateCollectionHandle(sCollectionName, CollectionPointer());
+  m_ColumnStores.erase(sCollectionName);
+  ResetKeyFilters(sCollectionName);
+  OnCollectionChanged(sCollectionName);
+  lazyCollection.m_bIsLoaded = false;
+  lazyCollection.m_iSize = 0;
+}
+
+void Database::EvictLazyCollections() {
+  if (m_iLazyMemoryBudget == 0) {
+    return;
+  }
+
+  size_t iTotalSize = 0;
+  LazyCollectionMap::iterator it = m_LazyCollections.begin();
+  for (; it != m_LazyCollections.end(); ++it) {
+    iTotalSize += it->second.m_iSize;
+  }
+
+  while (iTotalSize > m_iLazyMemoryBudget) {
+    LazyCollectionMap::iterator itOldest = m_LazyCollections.end();
+    unsigned iOldestTick = 0;
+    for (it = m_LazyCollections.begin(); it != m_LazyCollections.end(); ++it) {
+      if (!it->second.m_bIsLoaded) {
+        continue;
+      }
+      const unsigned iUseTick =
+        m_CollectionSlots[it->second.m_iCollectionHandle].m_iUseTick;
+      if (itOldest == m_LazyCollections.end() || iUseTick < iOldestTick) {
+        itOldest = it;
+        iOldestTick = iUseTick;
+      }
+    }
+    if (itOldest == m_LazyCollections.end()) {
+      break;
+    }
+    iTotalSize -= itOldest->second.m_iSize;
+    UnloadLazyCollection(itOldest->first, itOldest->second);
+  }
+}
+
+void Database::StartPrefetch() {
+  nE_StringVector vFiles;
+  LazyCollectionMap::const_iterator it = m_LazyCollections.begin();
+  for (; it != m_LazyCollections.end(); ++it) {
+    vFiles.insert(vFiles.end(), it->second.m_vFiles.begin(),
+                  it->second.m_vFiles.end());
+  }
+  if (vFiles.empty()) {
+    return;
+  }
+
+  m_PrefetchQueue.insert(vFiles.begin(), vFiles.end());
+  m_bStopPrefetch = false;
+  m_PrefetchThread = std::thread(&Database::PrefetchCollections, this, vFiles);
+}
+
+void Database::StopPrefetch() {
+  m_bStopPrefetch = true;
+  if (m_PrefetchThread.joinable()) {
+    m_PrefetchThread.join();
+  }
+  m_PrefetchQueue.clear();
+  m_PrefetchedFiles.clear();
+}
+
+// The thread only reads the raw files with the standard library: the data
+// and file utilities of the engine are not thread-safe, so the text is
+// parsed on the main thread when the collection is first used.
+void Database::PrefetchCollections(nE_StringVector vFiles) {
+  for (auto it = vFiles.begin(); it != vFiles.end() && !m_bStopPrefetch; ++it) {
+    {
+      std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+      if (m_PrefetchQueue.find(*it) == m_PrefetchQueue.end()) {
+        continue;
+      }
+    }
+    std::ifstream file((*it + ".json").c_str(),
+                       std::ios::in | std::ios::binary);
+    std::string sText((std::istreambuf_iterator<char>(file)),
+                      std::istreambuf_iterator<char>());
+    const bool bIsRead = !file.bad() && file.eof();
+    std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+    if (m_PrefetchQueue.erase(*it) > 0 && bIsRead) {
+      m_PrefetchedFiles[*it].swap(sText);
+    }
+  }
 }
 
 void Database::ReloadReadonlyCollections() {
   for (auto it = m_Collections.begin(); it != m_Collections.end();) {
     if (it->second->IsReadOnly()) {
-      m_Collections.erase(it++);
+      ResetKeyFilters(it->first);
+      OnCollectionChanged(it->first);
+      UpdateCollectionHandle(it->first, CollectionPointer());
+      it = m_Collections.erase(it);
     }
     else {
       ++it;
     }
   }
+  m_ColumnStores.clear();
   LoadReadonlyCollections();
 }
 
 std::string Database::CreateReadonlyCollection(nE_DataPointer pData) {
   CollectionPointer pNewCollection(new Collection());
   pNewCollection->SetCollectionData(pData);
+  return AddReadonlyCollection(pNewCollection, pData->AsTable());
+}
+
+std::string Database::AddReadonlyCollection(CollectionPointer pNewCollection,
+    const nE_DataTable* pOptions) {
+  bool bIsColumnar = nE_DataUtils::GetAsBool(pOptions, "columnar",
+                                             m_bIsColumnar);
   std::string sCollectionName(pNewCollection->GetName());
   CollectionPointer pCollection = GetCollection(sCollectionName);
   if (pCollection ==(CollectionPointer) NULL) {
     m_Collections.insert(CollectionMapPair(pNewCollection->GetName(),
                                            pNewCollection));
+    UpdateCollectionHandle(sCollectionName, pNewCollection);
+    pCollection = pNewCollection;
   }
   else {
     pCollection->AppendCollection(pNewCollection);
+    ResetKeyFilters(sCollectionName);
+    OnCollectionChanged(sCollectionName);
+  }
+  RegisterIndexFields(sCollectionName, pOptions->Get("indices"));
+  RegisterCoveringIndices(sCollectionName, pOptions->Get("include"));
+  if (bIsColumnar || GetColumnStore(sCollectionName) !=(ColumnStorePointer) NULL) {
+    BuildColumnStore(pCollection);
   }
+  RebuildViews(sCollectionName);
   return sCollectionName;
 }
 
+void Database::BuildColumnStore(CollectionPointer pCollection) {
+  ColumnStorePointer pColumnStore(new ColumnStore());
+  pColumnStore->Build(pCollection->GetItems()->AsArray());
+  m_ColumnStores[pCollection->GetName()] = pColumnStore;
+}
+
+ColumnStorePointer Database::GetColumnStore(const std::string&
+    sCollectionName) const {
+  ColumnStoreMap::const_iterator it = m_ColumnStores.find(sCollectionName);
+  if (it != m_ColumnStores.end()) {
+    return it->second;
+  }
+  else {
+    return ColumnStorePointer();
+  }
+}
+
 void Database::InitializeWritableCollections(const nE_DataTable* pOptionTable) {
   const nE_DataArray* pWritableCollections = nE_DataUtils::GetAsArrayNotNull(
         pOptionTable, "writable_collections");
@@ -259,7 +731,14 @@ std::string Database::CreateWritableCollection(nE_DataPointer pData) {
   CollectionPointer pCollection(new Collection());
   pCollection->SetReadOnly(false);
   pCollection->SetCollectionData(pData);
-  m_Collections.insert(CollectionMapPair(pCollection->GetName(), pCollection));
+  if (m_Collections.insert(CollectionMapPair(pCollection->GetName(),
+                                             pCollection)).second) {
+    UpdateCollectionHandle(pCollection->GetName(), pCollection);
+  }
+  RegisterIndexFields(pCollection->GetName(),
+                      pData->AsTable()->Get("indices"));
+  RegisterCoveringIndices(pCollection->GetName(),
+                          pData->AsTable()->Get("include"));
   return pCollection->GetName();
 }
 
@@ -270,6 +749,359 @@ std::string Database::CreateTemporaryCollection(nE_DataPointer pData) {
   return CreateWritableCollection(pData);
 }
 
+KeyFilterPointer Database::GetKeyFilter(const std::string& sCollectionName,
+                                       const std::string& sIndexName,
+                                       ReadonlyCollectionIndexPointer pIndex) {
+  if (!m_bUseKeyFilters || pIndex ==(ReadonlyCollectionIndexPointer) NULL) {
+    return KeyFilterPointer();
+  }
+  KeyFilterPointer& pKeyFilter = m_KeyFilters[sCollectionName][sIndexName];
+  if (pKeyFilter ==(KeyFilterPointer) NULL) {
+    pKeyFilter.reset(new KeyFilter());
+  }
+  if (!pKeyFilter->IsBuiltFor(pIndex.get()) || pKeyFilter->NeedsRebuild()) {
+    pKeyFilter->Build(pIndex.get());
+  }
+  return pKeyFilter;
+}
+
+// pItem is the whole new item or, for an update, only the changed fields: an
+// index whose field is not changed keeps its key. A filter whose new key
+// cannot be told is dropped and rebuilt on demand.
+void Database::AddToKeyFilters(const std::string& sCollectionName,
+                               const nE_DataTable* pItem, bool bIsUpdate) {
+  KeyFilterMap::iterator itCollection = m_KeyFilters.find(sCollectionName);
+  if (itCollection == m_KeyFilters.end()) {
+    return;
+  }
+  IndexKeyFilterMap& keyFilters = itCollection->second;
+  for (IndexKeyFilterMap::iterator it = keyFilters.begin();
+       it != keyFilters.end();) {
+    std::string sField;
+    const nE_Data* pValue = NULL;
+    if (GetIndexField(sCollectionName, it->first, sField)) {
+      pValue = pItem->Get(sField);
+    } else {
+      keyFilters.erase(it++);
+      continue;
+    }
+    if (pValue != NULL) {
+      it->second->Add(CollectionIndex::CreateKey(pValue).get(), !bIsUpdate);
+      ++it;
+    } else if (bIsUpdate) {
+      ++it;
+    } else {
+      keyFilters.erase(it++);
+    }
+  }
+}
+
+bool Database::GetIndexField(const std::string& sCollectionName,
+                             const std::string& sIndexName,
+                             std::string& sField) const {
+  if (sIndexName == Collection::DEFAULT_INDEX_NAME) {
+    sField = Collection::DEFAULT_INDEX_NAME;
+    return true;
+  }
+  CollectionIndexFieldMap::const_iterator itCollection = m_IndexFields.find(
+        sCollectionName);
+  if (itCollection == m_IndexFields.end()) {
+    return false;
+  }
+  IndexFieldMap::const_iterator it = itCollection->second.find(sIndexName);
+  if (it == itCollection->second.end()) {
+    return false;
+  }
+  sField = it->second;
+  return true;
+}
+
+void Database::RegisterIndexFields(const std::string& sCollectionName,
+                                   const nE_Data* pIndices) {
+  if (!IsTable(pIndices)) {
+    return;
+  }
+  IndexFieldMap& indexFields = m_IndexFields[sCollectionName];
+  nE_DataTableConstIterator it = pIndices->AsTable()->Begin();
+  for (; it != pIndices->AsTable()->End(); ++it) {
+    if (IsString(it.Value()) && !it.Value()->AsString().empty()) {
+      indexFields[it.Key()] = it.Value()->AsString();
+    }
+  }
+}
+
+void Database::DeleteFromKeyFilters(const std::string& sCollectionName,
+                                    size_t iCount) {
+  KeyFilterMap::iterator itCollection = m_KeyFilters.find(sCollectionName);
+  if (itCollection == m_KeyFilters.end()) {
+    return;
+  }
+  IndexKeyFilterMap& keyFilters = itCollection->second;
+  for (IndexKeyFilterMap::iterator it = keyFilters.begin();
+       it != keyFilters.end(); ++it) {
+    it->second->Delete(iCount);
+  }
+}
+
+void Database::ResetKeyFilters(const std::string& sCollectionName) {
+  m_KeyFilters.erase(sCollectionName);
+}
+
+nE_DataTablePointer Database::GetKeyFilterStatistics() const {
+  nE_DataTablePointer pStatistics(new nE_DataTable());
+  KeyFilterMap::const_iterator itCollection = m_KeyFilters.begin();
+  for (; itCollection != m_KeyFilters.end(); ++itCollection) {
+    nE_DataTable* pCollectionStatistics = pStatistics->PushNewTable(
+                                            itCollection->first);
+    IndexKeyFilterMap::const_iterator it = itCollection->second.begin();
+    for (; it != itCollection->second.end(); ++it) {
+      it->second->GetStatistics(pCollectionStatistics->PushNewTable(it->first));
+    }
+  }
+  return pStatistics;
+}
+
+void Database::RegisterCoveringIndices(const std::string& sCollectionName,
+                                       const nE_Data* pInclude) {
+  if (!IsTable(pInclude)) {
+    return;
+  }
+  IndexCoveringMap& coveringIndices = m_CoveringIndices[sCollectionName];
+  nE_DataTableConstIterator it = pInclude->AsTable()->Begin();
+  for (; it != pInclude->AsTable()->End(); ++it) {
+    const nE_DataArray* pFields = it.Value()->AsArray();
+    if (pFields == NULL) {
+      continue;
+    }
+    std::string sIndexField;
+    if (!GetIndexField(sCollectionName, it.Key(), sIndexField)) {
+      continue;
+    }
+    nE_StringVector vFields;
+    for (size_t i = 0; i < pFields->Size(); ++i) {
+      if (IsString(pFields->Get(i))) {
+        vFields.push_back(pFields->Get(i)->AsString());
+      }
+    }
+    coveringIndices[it.Key()].reset(new CoveringIndex(sIndexField, vFields));
+  }
+}
+
+CoveringIndexPointer Database::GetCoveringIndex(const std::string&
+    sCollectionName, const std::string& sIndexName,
+    ReadonlyCollectionIndexPointer pIndex, const nE_Data* pResult,
+    const std::string& sAlias) {
+  CoveringIndexMap::iterator itCollection = m_CoveringIndices.find(
+        sCollectionName);
+  if (itCollection == m_CoveringIndices.end() ||
+      pIndex ==(ReadonlyCollectionIndexPointer) NULL) {
+    return CoveringIndexPointer();
+  }
+  IndexCoveringMap::iterator it = itCollection->second.find(sIndexName);
+  if (it == itCollection->second.end() ||
+      !it->second->Covers(pResult, sAlias)) {
+    return CoveringIndexPointer();
+  }
+  if (!it->second->IsBuiltFor(pIndex.get())) {
+    it->second->Reset(pIndex.get());
+  }
+  return it->second;
+}
+
+void Database::RemoveFromCoveringIndices(const std::string& sCollectionName,
+                                         const nE_Data* pItem) {
+  CoveringIndexMap::iterator itCollection = m_CoveringIndices.find(
+        sCollectionName);
+  if (itCollection != m_CoveringIndices.end()) {
+    IndexCoveringMap::iterator it = itCollection->second.begin();
+    for (; it != itCollection->second.end(); ++it) {
+      it->second->Remove(pItem);
+    }
+  }
+}
+
+nE_DataTablePointer Database::GetQueryCacheStatistics() const {
+  nE_DataTablePointer pStatistics(new nE_DataTable());
+  m_QueryCache.GetStatistics(pStatistics.get());
+  return pStatistics;
+}
+
+unsigned Database::GetCollectionVersion(const std::string& sCollectionName)
+const {
+  CollectionVersionMap::const_iterator it = m_CollectionVersions.find(
+        sCollectionName);
+  if (it != m_CollectionVersions.end()) {
+    return it->second;
+  }
+  else {
+    return 0;
+  }
+}
+
+// The version is bumped by every write made through queries. The size of
+// the primary index is mixed in, so items inserted into or deleted from the
+// collection directly also make the cached results stale. A direct update
+// is not seen and has to go through an 'update' query instead.
+uint64_t Database::GetCacheVersion(const std::string& sCollectionName) const {
+  uint64_t iVersion = GetCollectionVersion(sCollectionName);
+  CollectionMap::const_iterator it = m_Collections.find(sCollectionName);
+  if (it != m_Collections.end()) {
+    ReadonlyCollectionIndexPointer pIndex = it->second->GetIndex(
+        Collection::DEFAULT_INDEX_NAME);
+    if (pIndex !=(ReadonlyCollectionIndexPointer) NULL) {
+      iVersion |= (uint64_t)pIndex->size() << 32;
+    }
+  }
+  return iVersion;
+}
+
+// Writes made item by item keep the covering entries up to date themselves
+// and leave the index objects in place; any other change drops the entries
+// and the index slots resolved for the collection's handle.
+void Database::OnCollectionChanged(const std::string& sCollectionName,
+                                   bool bIsBulkChange) {
+  ++m_CollectionVersions[sCollectionName];
+  if (!bIsBulkChange) {
+    return;
+  }
+  CollectionHandleMap::const_iterator itHandle = m_CollectionHandles.find(
+        sCollectionName);
+  if (itHandle != m_CollectionHandles.end()) {
+    ResetIndexSlots(itHandle->second);
+  }
+  CoveringIndexMap::iterator itCollection = m_CoveringIndices.find(
+        sCollectionName);
+  if (itCollection != m_CoveringIndices.end()) {
+    IndexCoveringMap::iterator it = itCollection->second.begin();
+    for (; it != itCollection->second.end(); ++it) {
+      it->second->Invalidate();
+    }
+  }
+}
+
+bool Database::CreateView(MaterializedViewPointer pView,
+                          QueryContext& queryContext) {
+  const std::string& sViewName = pView->GetName();
+  if (GetCollection(pView->GetSourceName()) ==(CollectionPointer) NULL) {
+    queryContext.GetErrorStorage().Add(
+      "The source collection of the view does not exist.", sViewName.c_str());
+    return false;
+  }
+  // View rows are written past the queries, so a view over a view would
+  // never learn about them.
+  if (m_Views.find(pView->GetSourceName()) != m_Views.end()) {
+    queryContext.GetErrorStorage().Add(
+      "The source collection of the view must not be a view.",
+      sViewName.c_str());
+    return false;
+  }
+  if (m_Views.find(sViewName) == m_Views.end()) {
+    if (GetCollection(sViewName) !=(CollectionPointer) NULL) {
+      queryContext.GetErrorStorage().Add(
+        "A collection with the name of the view already exists.",
+        sViewName.c_str());
+      return false;
+    }
+    nE_DataTable collectionOptions;
+    collectionOptions.Push("name", sViewName);
+    if (pView->GetIndices() != NULL) {
+      collectionOptions.PushCopy("indices", pView->GetIndices());
+    }
+    collectionOptions.PushNewArray("items");
+    CreateWritableCollection(nE_DataPointer(collectionOptions.Clone()));
+  }
+  m_Views[sViewName] = pView;
+  RebuildView(*pView, queryContext);
+  return true;
+}
+
+bool Database::HasViews(const std::string& sSourceName) const {
+  ViewMap::const_iterator it = m_Views.begin();
+  for (; it != m_Views.end(); ++it) {
+    if (it->second->GetSourceName() == sSourceName) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Database::AddToViews(const std::string& sSourceName,
+                          const nE_DataTable* pItem,
+                          QueryContext& queryContext) {
+  ViewMap::iterator it = m_Views.begin();
+  for (; it != m_Views.end(); ++it) {
+    if (it->second->GetSourceName() == sSourceName) {
+      CollectionPointer pCollection = GetCollection(it->first);
+      if (pCollection !=(CollectionPointer) NULL) {
+        it->second->AddItem(pItem, *pCollection, queryContext);
+      }
+    }
+  }
+}
+
+void Database::RemoveFromViews(const std::string& sSourceName,
+                               const nE_DataTable* pItem,
+                               QueryContext& queryContext) {
+  ViewMap::iterator it = m_Views.begin();
+  for (; it != m_Views.end(); ++it) {
+    if (it->second->GetSourceName() == sSourceName) {
+      CollectionPointer pCollection = GetCollection(it->first);
+      if (pCollection !=(CollectionPointer) NULL) {
+        it->second->RemoveItem(pItem, *pCollection, queryContext);
+      }
+    }
+  }
+}
+
+void Database::CompleteViews(const std::string& sSourceName) {
+  ViewMap::const_iterator it = m_Views.begin();
+  for (; it != m_Views.end(); ++it) {
+    if (it->second->GetSourceName() == sSourceName &&
+        it->second->IsChanged()) {
+      CompleteView(*it->second);
+    }
+  }
+}
+
+void Database::RebuildViews(const std::string& sCollectionName) {
+  if (m_Views.empty()) {
+    return;
+  }
+  QueryContext queryContext;
+  ViewMap::iterator it = m_Views.begin();
+  for (; it != m_Views.end(); ++it) {
+    if (it->first == sCollectionName ||
+        it->second->GetSourceName() == sCollectionName) {
+      RebuildView(*it->second, queryContext);
+    }
+  }
+}
+
+void Database::RebuildView(MaterializedView& view,
+                           QueryContext& queryContext) {
+  CollectionPointer pSource = GetCollection(view.GetSourceName());
+  CollectionPointer pCollection = GetCollection(view.GetName());
+  if (pSource ==(CollectionPointer) NULL ||
+      pCollection ==(CollectionPointer) NULL) {
+    return;
+  }
+  pCollection->DeleteAll();
+  view.Rebuild(pSource->GetItems()->AsArray(), *pCollection, queryContext);
+  CompleteView(view);
+}
+
+void Database::CompleteView(MaterializedView& view) {
+  // A view is derived data: it is rebuilt instead of being saved.
+  CollectionPointer pCollection = GetCollection(view.GetName());
+  if (pCollection !=(CollectionPointer) NULL) {
+    pCollection->ResetChanges();
+  }
+  view.ResetChanges();
+  ResetKeyFilters(view.GetName());
+  OnCollectionChanged(view.GetName());
+  SendCollectionUpdated(view.GetName());
+}
+
 void Database::GenerateTemporaryCollectionName(std::string& sCollectionName) {
   char sNameBuffer[ 30 ] = "";
   int nNameBufferSize = sprintf(sNameBuffer, "temp%020d",
@@ -278,6 +1110,31 @@ void Database::GenerateTemporaryCollectionName(std::string& sCollectionName) {
   sCollectionName = sNameBuffer;
 }
 
+// Only a query run in a context of its own is cached: a nested query sees
+// the items of the outer one, so it goes to ExecuteQueryInternal directly.
+QueryResultPointer Database::ExecuteCachedQuery(const nE_Data* pQueryData) {
+  std::string sCacheKey;
+  std::string sCollectionName;
+  bool bIsCached = m_QueryCache.IsEnabled() &&
+                   QueryCache::BuildKey(pQueryData, sCacheKey, sCollectionName);
+  if (bIsCached) {
+    QueryResultPointer pQueryResult = m_QueryCache.Find(sCacheKey,
+                                      GetCacheVersion(sCollectionName));
+    if (pQueryResult !=(QueryResultPointer) NULL) {
+      return pQueryResult;
+    }
+  }
+  QueryContext queryContext;
+  QueryResultPointer pQueryResult = ExecuteQueryInternal(pQueryData,
+                                    queryContext);
+  if (bIsCached && !pQueryResult->HasErrors()) {
+    m_QueryCache.Insert(sCacheKey, GetCacheVersion(sCollectionName),
+                        pQueryResult,
+                        EstimateDataSize(pQueryResult->GetResult().get()));
+  }
+  return pQueryResult;
+}
+
 QueryResultPointer Database::ExecuteQueryInternal(const nE_Data* pQueryData,
     QueryContext& queryContext) {
   Query query(this, &queryContext);
@@ -296,8 +1153,17 @@ QueryResultPointer Database::ExecuteQueryInternal(const nE_Data* pQueryData,
   }
 }
 
-CollectionPointer Database::GetCollection(const std::string& sCollectionName)
-const {
+CollectionPointer Database::GetCollection(const std::string&
+    sCollectionName) {
+  if (!m_LazyCollections.empty()) {
+    // Lazy collections are reached through their handles, which loads them
+    // on first access and stamps their use without another lookup.
+    CollectionHandleMap::const_iterator itHandle = m_CollectionHandles.find(
+          sCollectionName);
+    if (itHandle != m_CollectionHandles.end()) {
+      return GetCollection(itHandle->second);
+    }
+  }
   CollectionMap::const_iterator it = m_Collections.find(sCollectionName);
   if (it != m_Collections.end()) {
     return it->second;
@@ -307,6 +1173,99 @@ const {
   }
 }
 
+CollectionPointer Database::GetCollection(CollectionHandle
+    iCollectionHandle) {
+  if (iCollectionHandle >= m_CollectionSlots.size()) {
+    return CollectionPointer();
+  }
+  CollectionSlot& collectionSlot = m_CollectionSlots[iCollectionHandle];
+  if (!m_LazyCollections.empty()) {
+    collectionSlot.m_iUseTick = ++m_iLazyUseTick;
+    if (collectionSlot.m_pCollection ==(CollectionPointer) NULL) {
+      TouchLazyCollection(m_vCollectionHandleNames[iCollectionHandle]);
+    }
+  }
+  return collectionSlot.m_pCollection;
+}
+
+Database::CollectionHandle Database::GetCollectionHandle(const std::string&
+    sCollectionName) {
+  CollectionHandleMap::const_iterator it = m_CollectionHandles.find(
+        sCollectionName);
+  if (it != m_CollectionHandles.end()) {
+    return it->second;
+  }
+  // A handle outlives the collection it names, so it stays valid across
+  // reloads and lazy unloading and simply resolves to NULL meanwhile.
+  CollectionHandle iCollectionHandle = (CollectionHandle)
+                                       m_CollectionSlots.size();
+  m_CollectionHandles[sCollectionName] = iCollectionHandle;
+  m_vCollectionHandleNames.push_back(sCollectionName);
+  CollectionMap::const_iterator itCollection = m_Collections.find(
+        sCollectionName);
+  CollectionSlot collectionSlot;
+  collectionSlot.m_pCollection = (itCollection != m_Collections.end() ?
+                                  itCollection->second : CollectionPointer());
+  collectionSlot.m_iUseTick = 0;
+  m_CollectionSlots.push_back(collectionSlot);
+  return iCollectionHandle;
+}
+
+Database::IndexHandle Database::GetIndexHandle(CollectionHandle
+    iCollectionHandle, const std::string& sIndexName) {
+  if (iCollectionHandle >= m_CollectionSlots.size()) {
+    return INVALID_HANDLE;
+  }
+  std::vector<IndexHandle>& vIndexHandles =
+    m_CollectionSlots[iCollectionHandle].m_vIndexHandles;
+  for (size_t i = 0; i < vIndexHandles.size(); ++i) {
+    if (m_IndexSlots[vIndexHandles[i]].m_sIndexName == sIndexName) {
+      return vIndexHandles[i];
+    }
+  }
+  IndexSlot indexSlot;
+  indexSlot.m_iCollectionHandle = iCollectionHandle;
+  indexSlot.m_sIndexName = sIndexName;
+  m_IndexSlots.push_back(indexSlot);
+  vIndexHandles.push_back((IndexHandle)(m_IndexSlots.size() - 1));
+  return vIndexHandles.back();
+}
+
+const ReadonlyCollectionIndexPointer& Database::GetIndex(IndexHandle
+    iIndexHandle) {
+  if (iIndexHandle >= m_IndexSlots.size()) {
+    return s_pNullIndex;
+  }
+  IndexSlot& indexSlot = m_IndexSlots[iIndexHandle];
+  if (indexSlot.m_pIndex ==(ReadonlyCollectionIndexPointer) NULL) {
+    CollectionPointer pCollection = GetCollection(
+        indexSlot.m_iCollectionHandle);
+    if (pCollection !=(CollectionPointer) NULL) {
+      indexSlot.m_pIndex = pCollection->GetIndex(indexSlot.m_sIndexName);
+    }
+  }
+  return indexSlot.m_pIndex;
+}
+
+void Database::UpdateCollectionHandle(const std::string& sCollectionName,
+                                      const CollectionPointer& pCollection) {
+  CollectionHandleMap::const_iterator it = m_CollectionHandles.find(
+        sCollectionName);
+  if (it == m_CollectionHandles.end()) {
+    return;
+  }
+  m_CollectionSlots[it->second].m_pCollection = pCollection;
+  ResetIndexSlots(it->second);
+}
+
+void Database::ResetIndexSlots(CollectionHandle iCollectionHandle) {
+  const std::vector<IndexHandle>& vIndexHandles =
+    m_CollectionSlots[iCollectionHandle].m_vIndexHandles;
+  for (size_t i = 0; i < vIndexHandles.size(); ++i) {
+    m_IndexSlots[vIndexHandles[i]].m_pIndex.reset();
+  }
+}
+
 void Database::RegisterReadonlyCollections(nE_DataArray* pCollections) {
   bool bIsRegistered =
     RegisterNewReadonlyCollections(pCollections);
@@ -316,58 +1275,83 @@ void Database::RegisterReadonlyCollections(nE_DataArray* pCollections) {
 }
 
 bool Database::LoadWritableCollections() {
+  // Every store is read once into a staging collection. The collections are
+  // refilled from those only when all stores were read, so a damaged store
+  // leaves all collections as they are. The refill is made in place, keeping
+  // the pointers and handles callers hold valid.
   bool bResult = true;
-  nE_DataTable writableCollectionItems;
+  std::map<std::string, CollectionPointer> stagedCollections;
   CollectionMap::iterator it = m_Collections.begin();
   for (; bResult && it != m_Collections.end(); ++it) {
     CollectionPointer pCollection = it->second;
     if (pCollection->IsReadOnly() ||
-        !storage::Storage::GetInstance()->DataExists(pCollection->GetName())) {
+        !StorageDataExists(pCollection->GetName())) {
       continue;
     }
-
-    std::string sJsonItems;
-    bResult = (storage::Storage::GetInstance()->ReadData(pCollection->GetName(),
-               sJsonItems) == storage::StorageResult::OK);
-    if (!bResult) {
-      break;
-    }
-
-    nE_Data* pItems = nE_DataUtils::LoadDataFromJsonString(sJsonItems);
-    bResult = (pItems != NULL && pItems->AsArray() != NULL);
+    CollectionPointer pStagedCollection = ReadStoredItems(
+                                            pCollection->GetName());
+    bResult = (pStagedCollection !=(CollectionPointer) NULL);
     if (bResult) {
-      nE_DataArray* pItemArray = pItems->AsArray();
-      for (size_t i = 0; bResult && i < pItemArray->Size(); ++i) {
-        bResult = (pItemArray->Get(i) != NULL &&
-                   pItemArray->Get(i)->GetType() == nE_Data::Data_Table);
-      }
-    }
-
-    if (bResult) {
-      writableCollectionItems.Push(pCollection->GetName(), pItems);
-    }
-    else {
-      delete pItems;
+      stagedCollections[pCollection->GetName()] = pStagedCollection;
     }
   }
 
   if (bResult) {
-    nE_DataTableIterator it = writableCollectionItems.Begin();
-    for (; it != writableCollectionItems.End(); ++it) {
-      CollectionPointer pCollection = db::Database::GetInstance()->GetCollection(
-                                        it.Key());
+    std::map<std::string, CollectionPointer>::iterator it =
+      stagedCollections.begin();
+    for (; it != stagedCollections.end(); ++it) {
+      CollectionPointer pCollection = m_Collections[it->first];
       pCollection->DeleteAll();
-      nE_DataArray* pItemArray = it.Value()->AsArray();
-      for (size_t i = 0; i < pItemArray->Size(); ++i) {
-        pCollection->InsertItem(pItemArray->Get(i)->AsTable());
-      }
+      pCollection->AppendCollection(it->second);
       pCollection->ResetChanges();
+      ResetKeyFilters(it->first);
+      OnCollectionChanged(it->first);
+    }
+    for (it = stagedCollections.begin(); it != stagedCollections.end(); ++it) {
+      RebuildViews(it->first);
     }
   }
 
   return bResult;
 }
 
+CollectionPointer Database::ReadStoredItems(const std::string&
+    sCollectionName) {
+  std::string sJsonItems;
+  if (!ReadStorageData(sCollectionName, sJsonItems)) {
+    return CollectionPointer();
+  }
+  nE_DataTable collectionData;
+  collectionData.Push("name", sCollectionName);
+  collectionData.PushNewArray("items");
+  CollectionPointer pCollection(new Collection());
+  pCollection->SetReadOnly(false);
+  pCollection->SetCollectionData(nE_DataPointer(collectionData.Clone()));
+  {
+    CollectionStreamHandler handler(pCollection, true);
+    std::istringstream stream(sJsonItems);
+    JsonReader reader(stream);
+    if (reader.Read(handler) && handler.IsItemArray()) {
+      return pCollection;
+    }
+  }
+
+  // Whatever the streaming reader turns down is left to the engine parser.
+  pCollection->DeleteAll();
+  nE_DataPointer pItems(nE_DataUtils::LoadDataFromJsonString(sJsonItems));
+  if (pItems ==(nE_DataPointer) NULL || pItems->AsArray() == NULL) {
+    return CollectionPointer();
+  }
+  nE_DataArray* pItemArray = pItems->AsArray();
+  for (size_t i = 0; i < pItemArray->Size(); ++i) {
+    if (!IsTable(pItemArray->Get(i))) {
+      return CollectionPointer();
+    }
+    pCollection->InsertItem(pItemArray->Get(i)->AsTable());
+  }
+  return pCollection;
+}
+
 void Database::SaveWritableCollections() {
   CollectionMap::iterator it = m_Collections.begin();
   for (; it != m_Collections.end(); ++it) {
@@ -375,7 +1359,7 @@ void Database::SaveWritableCollections() {
     if (pCollection !=(CollectionPointer) NULL && pCollection->IsChanged()) {
       std::string sJsonItems;
       nE_DataUtils::SaveDataToJsonString(pCollection->GetItems(), sJsonItems, true);
-      storage::Storage::GetInstance()->WriteData(pCollection->GetName(), sJsonItems);
+      WriteStorageData(pCollection->GetName(), sJsonItems);
       pCollection->ResetChanges();
     }
   }
@@ -395,10 +1379,35 @@ void Database::Load(void) {
 void Database::CompleteLoading(void) {
   if (!m_bIsReady) {
     m_bIsReady = true;
-    nE_Mediator::GetInstance()->SendMessage(Messages::Event_Db_Ready, NULL);
+    SendDbReady();
   }
 }
 
+bool Database::StorageDataExists(const std::string& sKey) {
+  return storage::Storage::GetInstance()->DataExists(sKey);
+}
+
+bool Database::ReadStorageData(const std::string& sKey, std::string& sData) {
+  return (storage::Storage::GetInstance()->ReadData(sKey, sData) ==
+          storage::StorageResult::OK);
+}
+
+void Database::WriteStorageData(const std::string& sKey,
+                                const std::string& sData) {
+  storage::Storage::GetInstance()->WriteData(sKey, sData);
+}
+
+void Database::SendDbReady() {
+  nE_Mediator::GetInstance()->SendMessage(Messages::Event_Db_Ready, NULL);
+}
+
+void Database::SendCollectionUpdated(const std::string& sCollectionName) {
+  nE_DataTable collectionInfo;
+  collectionInfo.Push("collection", sCollectionName);
+  nE_Mediator::GetInstance()->SendMessage(Messages::Event_Db_CollectionUpdated,
+                                          &collectionInfo);
+}
+
 void Database::Handle_Command_SaveState(nE_DataTable* pTable) {
   SaveWritableCollections();
 }
@@ -407,6 +1416,9 @@ void Database::Handle_Event_HeartBeat(nE_DataTable* pTable) {
   if (!m_bIsReady) {
     Load();
   }
+  else {
+    EvictLazyCollections();
+  }
 }
 
 nE_DataArrayPointer Database::CreateDump(const nE_DataTable* pDumpTable) {
@@ -437,6 +1449,105 @@ bool Database::ApplyDump(const nE_DataArray* pDumpArray) {
   return true;
 }
 
+bool Database::CreateDump(const nE_DataTable* pDumpTable,
+                          std::ostream& stream) {
+  nE_DataTableConstIterator it = pDumpTable->Begin();
+  for (; it != pDumpTable->End(); it++) {
+    CollectionPointer pCollection = GetCollection(it.Key());
+    if (pCollection ==(CollectionPointer) NULL) {
+      continue;
+    }
+
+    const nE_DataArray* pItems = pCollection->GetItems()->AsArray();
+    nE_DataTable header;
+    header.Push("collection", it.Value()->AsString());
+    header.Push("items", (int)pItems->Size());
+    std::string sRecord;
+    nE_DataUtils::SaveDataToJsonString(&header, sRecord, true);
+    WriteDumpRecord(stream, sRecord);
+
+    for (size_t iFirst = 0; iFirst < pItems->Size(); iFirst += DUMP_CHUNK_SIZE) {
+      const size_t iLast = std::min(iFirst + DUMP_CHUNK_SIZE, pItems->Size());
+      sRecord = "[";
+      for (size_t i = iFirst; i < iLast; ++i) {
+        std::string sItem;
+        nE_DataUtils::SaveDataToJsonString(pItems->Get(i), sItem, true);
+        if (i > iFirst) {
+          sRecord += ",";
+        }
+        sRecord += sItem;
+      }
+      sRecord += "]";
+      WriteDumpRecord(stream, sRecord);
+    }
+  }
+  return stream.good();
+}
+
+bool Database::ApplyDump(std::istream& stream) {
+  bool bResult = true;
+  CollectionPointer pCollection;
+  int iItemCount = 0;
+  int iInsertedCount = 0;
+  std::string sRecord;
+  while (bResult && stream.peek() != std::char_traits<char>::eof()) {
+    bResult = ReadDumpRecord(stream, sRecord);
+    if (!bResult) {
+      break;
+    }
+
+    nE_DataPointer pRecord(nE_DataUtils::LoadDataFromJsonString(sRecord));
+    if (IsTable(pRecord.get())) {
+      // A dump cut at a record boundary is told by the item count.
+      bResult = (iInsertedCount == iItemCount);
+      CompleteDumpCollection(pCollection);
+      pCollection = GetCollection(nE_DataUtils::GetAsString(pRecord.get(),
+                                  "collection", ""));
+      iItemCount = nE_DataUtils::GetAsInt(pRecord.get(), "items", 0);
+      iInsertedCount = 0;
+      bResult = (bResult && pCollection !=(CollectionPointer) NULL &&
+                 !pCollection->IsReadOnly());
+    }
+    else if (pRecord !=(nE_DataPointer) NULL &&
+             pRecord->GetType() == nE_Data::Data_Array &&
+             pCollection !=(CollectionPointer) NULL) {
+      nE_DataArray* pItemArray = pRecord->AsArray();
+      for (size_t i = 0; bResult && i < pItemArray->Size(); ++i) {
+        bResult = IsTable(pItemArray->Get(i));
+        if (bResult) {
+          pCollection->InsertItem(pItemArray->Get(i)->AsTable());
+          ++iInsertedCount;
+        }
+      }
+    }
+    else {
+      bResult = false;
+    }
+  }
+  CompleteDumpCollection(pCollection);
+  return (bResult && iInsertedCount == iItemCount);
+}
+
+bool Database::CreateDumpFile(const nE_DataTable* pDumpTable,
+                              const std::string& sFilePath) {
+  std::ofstream file(sFilePath.c_str(), std::ios::out | std::ios::binary);
+  return (file.is_open() && CreateDump(pDumpTable, file));
+}
+
+bool Database::ApplyDumpFile(const std::string& sFilePath) {
+  std::ifstream file(sFilePath.c_str(), std::ios::in | std::ios::binary);
+  return (file.is_open() && ApplyDump(file));
+}
+
+void Database::CompleteDumpCollection(CollectionPointer pCollection) {
+  if (pCollection !=(CollectionPointer) NULL) {
+    ResetKeyFilters(pCollection->GetName());
+    OnCollectionChanged(pCollection->GetName());
+    SendCollectionUpdated(pCollection->GetName());
+    RebuildViews(pCollection->GetName());
+  }
+}
+
 }
 }
 
@@ -9,6 +9,17 @@
 #define DATABASE_H_F93E67C9_6863_4DFE_AF0B_5316F5614C4F
 
 #include "query_result.h"
+#include "column_store.h"
+#include "key_filter.h"
+#include "covering_index.h"
+#include "query_cache.h"
+#include "materialized_view.h"
+#include <atomic>
+#include <deque>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace parts {
 
@@ -24,6 +35,12 @@ class Database : public ListenerBase {
   friend class parts::db::Query;
   friend class parts::db::QueryContext;
 
+ public:
+  typedef unsigned CollectionHandle;
+  typedef unsigned IndexHandle;
+
+  static const unsigned INVALID_HANDLE = UINT_MAX;
+
  public:
   static Database* GetInstance();
 
@@ -38,8 +55,23 @@ class Database : public ListenerBase {
                                         QueryResultVector* pQueryResultVector = NULL);
   nE_DataArrayPointer CreateDump(const nE_DataTable* pDumpTable);
   bool                ApplyDump(const nE_DataArray* pDumpArray);
-  CollectionPointer   GetCollection(const std::string& sCollectionName) const;
+  bool                CreateDump(const nE_DataTable* pDumpTable,
+                                 std::ostream& stream);
+  bool                ApplyDump(std::istream& stream);
+  bool                CreateDumpFile(const nE_DataTable* pDumpTable,
+                                     const std::string& sFilePath);
+  bool                ApplyDumpFile(const std::string& sFilePath);
+  CollectionPointer   GetCollection(const std::string& sCollectionName);
+  CollectionPointer   GetCollection(CollectionHandle iCollectionHandle);
+  CollectionHandle    GetCollectionHandle(const std::string& sCollectionName);
+  IndexHandle         GetIndexHandle(CollectionHandle iCollectionHandle,
+                                     const std::string& sIndexName);
+  const ReadonlyCollectionIndexPointer& GetIndex(IndexHandle iIndexHandle);
   void                RegisterReadonlyCollections(nE_DataArray* pCollections);
+  nE_DataTablePointer GetKeyFilterStatistics() const;
+  nE_DataTablePointer GetQueryCacheStatistics() const;
+  unsigned            GetCollectionVersion(const std::string& sCollectionName)
+  const;
 
  protected:
   static void ScriptExecuteQuery(nE_DataArray* pArgs, void* pUserBoundData,
@@ -57,8 +89,50 @@ class Database : public ListenerBase {
   INVOKE_MAP_END
 
  protected:
-  typedef std::map<std::string, CollectionPointer> CollectionMap;
+  typedef std::unordered_map<std::string, CollectionPointer> CollectionMap;
   typedef std::pair<std::string, CollectionPointer> CollectionMapPair;
+  typedef std::map<std::string, ColumnStorePointer> ColumnStoreMap;
+  typedef std::map<std::string, KeyFilterPointer> IndexKeyFilterMap;
+  typedef std::map<std::string, IndexKeyFilterMap> KeyFilterMap;
+  typedef std::map<std::string, CoveringIndexPointer> IndexCoveringMap;
+  typedef std::map<std::string, IndexCoveringMap> CoveringIndexMap;
+  typedef std::map<std::string, std::string> PrefetchedFileMap;
+  typedef std::map<std::string, unsigned> CollectionVersionMap;
+  typedef std::map<std::string, MaterializedViewPointer> ViewMap;
+  typedef std::map<std::string, std::string> IndexFieldMap;
+  typedef std::map<std::string, IndexFieldMap> CollectionIndexFieldMap;
+
+  // The least recently used lazy collection is evicted first. Every lazy
+  // collection has a handle, so a hit in GetCollection only stamps the use
+  // tick of its slot.
+  struct LazyCollection {
+    nE_StringVector  m_vFiles;
+    bool             m_bIsLoaded;
+    size_t           m_iSize;
+    CollectionHandle m_iCollectionHandle;
+
+    LazyCollection();
+  };
+
+  typedef std::map<std::string, LazyCollection> LazyCollectionMap;
+  typedef std::unordered_map<std::string, CollectionHandle> CollectionHandleMap;
+
+  struct IndexSlot {
+    CollectionHandle               m_iCollectionHandle;
+    std::string                    m_sIndexName;
+    ReadonlyCollectionIndexPointer m_pIndex;
+  };
+
+  struct CollectionSlot {
+    CollectionPointer        m_pCollection;
+    unsigned                 m_iUseTick;
+    std::vector<IndexHandle> m_vIndexHandles;
+  };
+
+  // Slots are kept in deques, so the reference GetIndex returns for a handle
+  // stays valid while more handles are made.
+  typedef std::deque<CollectionSlot> CollectionSlotDeque;
+  typedef std::deque<IndexSlot> IndexSlotDeque;
 
  protected:
   Database(const nE_DataTable* pOptionTable);
@@ -70,6 +144,10 @@ class Database : public ListenerBase {
   void               InitializeSystemCollections();
   nE_DataPointer     ReadCollectionData(const std::string& sCollectionFilePath,
                                         bool bIsEncoded);
+  CollectionPointer  ReadCollection(const std::string& sCollectionFilePath,
+                                    nE_DataTablePointer& pOptions);
+  CollectionPointer  ReadCollection(std::istream& stream,
+                                    nE_DataTablePointer& pOptions);
   void               InitializeReadonlyCollections(const nE_DataTable*
       pOptionTable);
 
@@ -80,32 +158,121 @@ class Database : public ListenerBase {
 
   void               LoadReadonlyCollections();
   void               ReloadReadonlyCollections();
+  void               TouchLazyCollection(const std::string& sCollectionName);
+  void               ResetIndexSlots(CollectionHandle iCollectionHandle);
+  void               LoadLazyCollection(const std::string& sCollectionName,
+                                        LazyCollection& lazyCollection);
+  void               UnloadLazyCollection(const std::string& sCollectionName,
+                                          LazyCollection& lazyCollection);
+  void               EvictLazyCollections();
+  void               StartPrefetch();
+  void               StopPrefetch();
+  void               PrefetchCollections(nE_StringVector vFiles);
 
   std::string        CreateReadonlyCollection(nE_DataPointer pData);
+  std::string        AddReadonlyCollection(CollectionPointer pNewCollection,
+                                           const nE_DataTable* pOptions);
+  void               UpdateCollectionHandle(const std::string& sCollectionName,
+                                            const CollectionPointer& pCollection);
+  void               BuildColumnStore(CollectionPointer pCollection);
+  ColumnStorePointer GetColumnStore(const std::string& sCollectionName) const;
 
   void               InitializeWritableCollections(const nE_DataTable*
       pOptionTable);
   std::string        CreateWritableCollection(nE_DataPointer pData);
 
   std::string        CreateTemporaryCollection(nE_DataPointer pData);
+  KeyFilterPointer   GetKeyFilter(const std::string& sCollectionName,
+                                  const std::string& sIndexName,
+                                  ReadonlyCollectionIndexPointer pIndex);
+  void               AddToKeyFilters(const std::string& sCollectionName,
+                                     const nE_DataTable* pItem, bool bIsUpdate);
+  bool               GetIndexField(const std::string& sCollectionName,
+                                   const std::string& sIndexName,
+                                   std::string& sField) const;
+  void               DeleteFromKeyFilters(const std::string& sCollectionName,
+                                          size_t iCount);
+  void               ResetKeyFilters(const std::string& sCollectionName);
+  void               RegisterIndexFields(const std::string& sCollectionName,
+                                         const nE_Data* pIndices);
+  void               RegisterCoveringIndices(const std::string& sCollectionName,
+                                             const nE_Data* pInclude);
+  CoveringIndexPointer GetCoveringIndex(const std::string& sCollectionName,
+                                        const std::string& sIndexName,
+                                        ReadonlyCollectionIndexPointer pIndex,
+                                        const nE_Data* pResult,
+                                        const std::string& sAlias);
+  void               RemoveFromCoveringIndices(const std::string& sCollectionName,
+                                               const nE_Data* pItem);
+  void               OnCollectionChanged(const std::string& sCollectionName,
+                                         bool bIsBulkChange = true);
+  bool               CreateView(MaterializedViewPointer pView,
+                                QueryContext& queryContext);
+  bool               HasViews(const std::string& sSourceName) const;
+  void               AddToViews(const std::string& sSourceName,
+                                const nE_DataTable* pItem,
+                                QueryContext& queryContext);
+  void               RemoveFromViews(const std::string& sSourceName,
+                                     const nE_DataTable* pItem,
+                                     QueryContext& queryContext);
+  void               CompleteViews(const std::string& sSourceName);
+  void               RebuildViews(const std::string& sCollectionName);
+  void               RebuildView(MaterializedView& view,
+                                 QueryContext& queryContext);
+  void               CompleteView(MaterializedView& view);
   void               GenerateTemporaryCollectionName(std::string&
       sCollectionName);
 
   virtual bool       LoadWritableCollections();
+  CollectionPointer  ReadStoredItems(const std::string& sCollectionName);
   virtual void       SaveWritableCollections();
 
+  virtual bool       StorageDataExists(const std::string& sKey);
+  virtual bool       ReadStorageData(const std::string& sKey, std::string& sData);
+  virtual void       WriteStorageData(const std::string& sKey,
+                                      const std::string& sData);
+  virtual void       SendDbReady();
+  virtual void       SendCollectionUpdated(const std::string& sCollectionName);
+
   void               Load(void);
   void               CompleteLoading();
 
+  QueryResultPointer ExecuteCachedQuery(const nE_Data* pQueryData);
+  uint64_t           GetCacheVersion(const std::string& sCollectionName) const;
   QueryResultPointer ExecuteQueryInternal(const nE_Data* pQueryData,
                                           QueryContext& queryContext);
+  void               CompleteDumpCollection(CollectionPointer pCollection);
 
  protected:
   static Database*   s_pInstance;
   bool               m_bIsCorrupted;
   bool               m_bIsReady;
   CollectionMap      m_Collections;
+  CollectionHandleMap m_CollectionHandles;
+  nE_StringVector    m_vCollectionHandleNames;
+  CollectionSlotDeque m_CollectionSlots;
+  IndexSlotDeque     m_IndexSlots;
+  ColumnStoreMap     m_ColumnStores;
+  bool               m_bIsColumnar;
+  KeyFilterMap       m_KeyFilters;
+  bool               m_bUseKeyFilters;
+  CoveringIndexMap   m_CoveringIndices;
+  QueryCache         m_QueryCache;
+  CollectionVersionMap m_CollectionVersions;
+  ViewMap            m_Views;
+  LazyCollectionMap  m_LazyCollections;
+  bool               m_bIsStreamed;
+  bool               m_bIsLazy;
+  bool               m_bIsPrefetched;
+  size_t             m_iLazyMemoryBudget;
+  unsigned           m_iLazyUseTick;
+  std::thread        m_PrefetchThread;
+  std::mutex         m_PrefetchMutex;
+  std::atomic<bool>  m_bStopPrefetch;
+  std::set<std::string> m_PrefetchQueue;
+  PrefetchedFileMap  m_PrefetchedFiles;
   nE_DataTable       m_ReadonlyCollectionOptions;
+  CollectionIndexFieldMap m_IndexFields;
   nE_StringVector    m_vReadonlyCollections;
   int                m_iNextTemporaryCollection;
 };
@@ -0,0 +1,509 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#include "parts/include.h"
+#include "json_reader.h"
+#include <istream>
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+
+namespace parts {
+namespace db {
+
+namespace {
+
+const int MAX_DEPTH = 512;
+
+void AppendUtf8(unsigned iCode, std::string& sValue) {
+  if (iCode < 0x80) {
+    sValue += (char)iCode;
+  } else if (iCode < 0x800) {
+    sValue += (char)(0xC0 | (iCode >> 6));
+    sValue += (char)(0x80 | (iCode & 0x3F));
+  } else if (iCode < 0x10000) {
+    sValue += (char)(0xE0 | (iCode >> 12));
+    sValue += (char)(0x80 | ((iCode >> 6) & 0x3F));
+    sValue += (char)(0x80 | (iCode & 0x3F));
+  } else {
+    sValue += (char)(0xF0 | (iCode >> 18));
+    sValue += (char)(0x80 | ((iCode >> 12) & 0x3F));
+    sValue += (char)(0x80 | ((iCode >> 6) & 0x3F));
+    sValue += (char)(0x80 | (iCode & 0x3F));
+  }
+}
+
+}
+
+JsonReader::JsonReader(std::istream& stream)
+  : m_pBuffer(stream.rdbuf()),
+    m_iOffset(0) {}
+
+bool JsonReader::Read(JsonHandler& handler) {
+  m_sError.clear();
+  m_iOffset = 0;
+  if (m_pBuffer == NULL) {
+    return Fail("The stream has no buffer.");
+  }
+  SkipSpaces();
+  if (!ReadValue(handler, 0)) {
+    return false;
+  }
+  SkipSpaces();
+  if (Peek() != EOF) {
+    return Fail("Unexpected data after the end of the document.");
+  }
+  return true;
+}
+
+const std::string& JsonReader::GetError() const {
+  return m_sError;
+}
+
+bool JsonReader::ReadValue(JsonHandler& handler, int iDepth) {
+  if (iDepth > MAX_DEPTH) {
+    return Fail("The document is nested too deeply.");
+  }
+  switch (Peek()) {
+    case '{':
+      return ReadTable(handler, iDepth);
+    case '[':
+      return ReadArray(handler, iDepth);
+    case '"': {
+      std::string sValue;
+      if (!ReadString(sValue)) {
+        return false;
+      }
+      return handler.OnValue(new nE_DataString(sValue)) ||
+             Fail("The value was rejected.");
+    }
+    case 't':
+    case 'f':
+    case 'n':
+      return ReadLiteral(handler);
+    case EOF:
+      return Fail("Unexpected end of the document.");
+    default:
+      return ReadNumber(handler);
+  }
+}
+
+bool JsonReader::ReadTable(JsonHandler& handler, int iDepth) {
+  Next();
+  if (!handler.OnStartTable()) {
+    return Fail("The table was rejected.");
+  }
+  SkipSpaces();
+  if (Peek() == '}') {
+    Next();
+    return handler.OnEndTable() || Fail("The table was rejected.");
+  }
+  while (true) {
+    SkipSpaces();
+    std::string sKey;
+    if (Peek() != '"' || !ReadString(sKey)) {
+      return Fail("A table key must be a string.");
+    }
+    if (!handler.OnKey(sKey)) {
+      return Fail("The key was rejected.");
+    }
+    SkipSpaces();
+    if (Next() != ':') {
+      return Fail("Expected ':' after a table key.");
+    }
+    SkipSpaces();
+    if (!ReadValue(handler, iDepth + 1)) {
+      return false;
+    }
+    SkipSpaces();
+    int iChar = Next();
+    if (iChar == '}') {
+      return handler.OnEndTable() || Fail("The table was rejected.");
+    } else if (iChar != ',') {
+      return Fail("Expected ',' or '}' in a table.");
+    }
+  }
+}
+
+bool JsonReader::ReadArray(JsonHandler& handler, int iDepth) {
+  Next();
+  if (!handler.OnStartArray()) {
+    return Fail("The array was rejected.");
+  }
+  SkipSpaces();
+  if (Peek() == ']') {
+    Next();
+    return handler.OnEndArray() || Fail("The array was rejected.");
+  }
+  while (true) {
+    SkipSpaces();
+    if (!ReadValue(handler, iDepth + 1)) {
+      return false;
+    }
+    SkipSpaces();
+    int iChar = Next();
+    if (iChar == ']') {
+      return handler.OnEndArray() || Fail("The array was rejected.");
+    } else if (iChar != ',') {
+      return Fail("Expected ',' or ']' in an array.");
+    }
+  }
+}
+
+bool JsonReader::ReadString(std::string& sValue) {
+  Next();
+  while (true) {
+    int iChar = Next();
+    if (iChar == EOF) {
+      return Fail("Unexpected end of a string.");
+    } else if (iChar == '"') {
+      return true;
+    } else if (iChar != '\\') {
+      sValue += (char)iChar;
+      continue;
+    }
+
+    iChar = Next();
+    switch (iChar) {
+      case '"':
+      case '\\':
+      case '/':
+        sValue += (char)iChar;
+        break;
+      case 'b':
+        sValue += '\b';
+        break;
+      case 'f':
+        sValue += '\f';
+        break;
+      case 'n':
+        sValue += '\n';
+        break;
+      case 'r':
+        sValue += '\r';
+        break;
+      case 't':
+        sValue += '\t';
+        break;
+      case 'u': {
+        unsigned iCode = 0;
+        if (!ReadHex(iCode)) {
+          return false;
+        }
+        if (iCode >= 0xD800 && iCode < 0xDC00) {
+          unsigned iLowCode = 0;
+          if (Next() != '\\' || Next() != 'u' || !ReadHex(iLowCode) ||
+              iLowCode < 0xDC00 || iLowCode >= 0xE000) {
+            return Fail("Invalid surrogate pair in a string.");
+          }
+          iCode = 0x10000 + ((iCode - 0xD800) << 10) + (iLowCode - 0xDC00);
+        }
+        AppendUtf8(iCode, sValue);
+        break;
+      }
+      default:
+        return Fail("Invalid escape sequence in a string.");
+    }
+  }
+}
+
+bool JsonReader::ReadNumber(JsonHandler& handler) {
+  std::string sNumber;
+  bool bIsFloat = false;
+  int iChar = Peek();
+  while (iChar != EOF && (isdigit(iChar) || iChar == '-' || iChar == '+' ||
+                          iChar == '.' || iChar == 'e' || iChar == 'E')) {
+    bIsFloat = bIsFloat || (iChar == '.' || iChar == 'e' || iChar == 'E');
+    sNumber += (char)Next();
+    iChar = Peek();
+  }
+  if (sNumber.empty()) {
+    return Fail("Unexpected character.");
+  }
+
+  char* pEnd = NULL;
+  nE_Data* pValue = NULL;
+  if (!bIsFloat) {
+    errno = 0;
+    long iValue = strtol(sNumber.c_str(), &pEnd, 10);
+    if (*pEnd == 0 && errno == 0 && iValue >= INT_MIN && iValue <= INT_MAX) {
+      pValue = new nE_DataInt((int)iValue);
+    } else {
+      // The engine parser keeps such integers in its own way, so the
+      // document is left to it rather than read as a float.
+      return Fail("An integer is out of range.");
+    }
+  }
+  if (pValue == NULL) {
+    double fValue = strtod(sNumber.c_str(), &pEnd);
+    if (*pEnd != 0) {
+      return Fail("Invalid number.");
+    }
+    pValue = new nE_DataFloat((float)fValue);
+  }
+  return handler.OnValue(pValue) || Fail("The value was rejected.");
+}
+
+bool JsonReader::ReadLiteral(JsonHandler& handler) {
+  std::string sLiteral;
+  while (isalpha(Peek())) {
+    sLiteral += (char)Next();
+  }
+  nE_Data* pValue = NULL;
+  if (sLiteral == "true") {
+    pValue = new nE_DataBool(true);
+  } else if (sLiteral == "false") {
+    pValue = new nE_DataBool(false);
+  } else if (sLiteral == "null") {
+    pValue = new nE_Data();
+  } else {
+    return Fail("Unknown literal.");
+  }
+  return handler.OnValue(pValue) || Fail("The value was rejected.");
+}
+
+bool JsonReader::ReadHex(unsigned& iValue) {
+  iValue = 0;
+  for (int i = 0; i < 4; ++i) {
+    int iChar = Next();
+    iValue <<= 4;
+    if (iChar >= '0' && iChar <= '9') {
+      iValue |= iChar - '0';
+    } else if (iChar >= 'a' && iChar <= 'f') {
+      iValue |= iChar - 'a' + 10;
+    } else if (iChar >= 'A' && iChar <= 'F') {
+      iValue |= iChar - 'A' + 10;
+    } else {
+      return Fail("Invalid \\u escape in a string.");
+    }
+  }
+  return true;
+}
+
+int JsonReader::Peek() {
+  return m_pBuffer->sgetc();
+}
+
+int JsonReader::Next() {
+  int iChar = m_pBuffer->sbumpc();
+  if (iChar != EOF) {
+    ++m_iOffset;
+  }
+  return iChar;
+}
+
+void JsonReader::SkipSpaces() {
+  int iChar = Peek();
+  while (iChar == ' ' || iChar == '\t' || iChar == '\n' || iChar == '\r') {
+    Next();
+    iChar = Peek();
+  }
+}
+
+bool JsonReader::Fail(const char* sMessage) {
+  if (m_sError.empty()) {
+    char sOffset[32];
+    sprintf(sOffset, " (offset %u)", (unsigned)m_iOffset);
+    m_sError = sMessage;
+    m_sError += sOffset;
+  }
+  return false;
+}
+
+JsonDataBuilder::JsonDataBuilder()
+  : m_pRoot(NULL) {}
+
+JsonDataBuilder::~JsonDataBuilder() {
+  Reset();
+}
+
+void JsonDataBuilder::Reset() {
+  delete m_pRoot;
+  m_pRoot = NULL;
+  m_vContainers.clear();
+  m_sKey.clear();
+}
+
+nE_Data* JsonDataBuilder::Release() {
+  nE_Data* pRoot = m_pRoot;
+  m_pRoot = NULL;
+  m_vContainers.clear();
+  return pRoot;
+}
+
+bool JsonDataBuilder::OnStartTable() {
+  nE_Data* pTable = NULL;
+  if (m_vContainers.empty()) {
+    if (m_pRoot != NULL) {
+      return false;
+    }
+    pTable = m_pRoot = new nE_DataTable();
+  } else if (m_vContainers.back()->GetType() == nE_Data::Data_Table) {
+    pTable = m_vContainers.back()->AsTable()->PushNewTable(m_sKey);
+  } else {
+    pTable = m_vContainers.back()->AsArray()->PushNewTable();
+  }
+  m_vContainers.push_back(pTable);
+  return true;
+}
+
+bool JsonDataBuilder::OnKey(const std::string& sKey) {
+  m_sKey = sKey;
+  return true;
+}
+
+bool JsonDataBuilder::OnEndTable() {
+  m_vContainers.pop_back();
+  return true;
+}
+
+bool JsonDataBuilder::OnStartArray() {
+  nE_Data* pArray = NULL;
+  if (m_vContainers.empty()) {
+    if (m_pRoot != NULL) {
+      return false;
+    }
+    pArray = m_pRoot = new nE_DataArray();
+  } else if (m_vContainers.back()->GetType() == nE_Data::Data_Table) {
+    pArray = m_vContainers.back()->AsTable()->PushNewArray(m_sKey);
+  } else {
+    pArray = m_vContainers.back()->AsArray()->PushNewArray();
+  }
+  m_vContainers.push_back(pArray);
+  return true;
+}
+
+bool JsonDataBuilder::OnEndArray() {
+  m_vContainers.pop_back();
+  return true;
+}
+
+bool JsonDataBuilder::OnValue(nE_Data* pValue) {
+  if (m_vContainers.empty()) {
+    if (m_pRoot != NULL) {
+      delete pValue;
+      return false;
+    }
+    m_pRoot = pValue;
+  } else if (m_vContainers.back()->GetType() == nE_Data::Data_Table) {
+    m_vContainers.back()->AsTable()->Push(m_sKey, pValue);
+  } else {
+    m_vContainers.back()->AsArray()->Push(pValue);
+  }
+  return true;
+}
+
+JsonItemHandler::JsonItemHandler()
+  : m_iDepth(0),
+    m_iItemsDepth(0),
+    m_iBuildDepth(0),
+    m_bIsInItems(false),
+    m_bIsBuilding(false),
+    m_bHasItems(false),
+    m_bIsItemArray(false) {}
+
+bool JsonItemHandler::HasItems() const {
+  return m_bHasItems;
+}
+
+bool JsonItemHandler::IsItemArray() const {
+  return m_bIsItemArray;
+}
+
+bool JsonItemHandler::OnStartTable() {
+  return StartContainer(true);
+}
+
+bool JsonItemHandler::OnKey(const std::string& sKey) {
+  if (m_bIsBuilding) {
+    return m_Builder.OnKey(sKey);
+  }
+  // Options after the items would come too late for the collection that
+  // is already being filled.
+  m_sKey = sKey;
+  return !m_bHasItems;
+}
+
+bool JsonItemHandler::OnEndTable() {
+  return EndContainer(true);
+}
+
+bool JsonItemHandler::OnStartArray() {
+  return StartContainer(false);
+}
+
+bool JsonItemHandler::OnEndArray() {
+  return EndContainer(false);
+}
+
+bool JsonItemHandler::OnValue(nE_Data* pValue) {
+  if (m_bIsBuilding) {
+    return m_Builder.OnValue(pValue);
+  } else if (m_iDepth == 1 && !m_bIsInItems) {
+    m_Options.Push(m_sKey, pValue);
+    return true;
+  } else {
+    delete pValue;
+    return false;
+  }
+}
+
+bool JsonItemHandler::StartContainer(bool bIsTable) {
+  if (!m_bIsBuilding) {
+    if (m_iDepth == 0) {
+      ++m_iDepth;
+      if (bIsTable) {
+        return true;
+      }
+      m_bIsInItems = true;
+      m_bIsItemArray = true;
+      m_iItemsDepth = 0;
+      return OnOptions(&m_Options);
+    } else if (m_bIsInItems) {
+      if (!bIsTable) {
+        return false;
+      }
+    } else if (m_iDepth == 1 && !bIsTable && m_sKey == "items") {
+      m_bIsInItems = true;
+      m_iItemsDepth = m_iDepth++;
+      return OnOptions(&m_Options);
+    }
+    m_bIsBuilding = true;
+    m_iBuildDepth = m_iDepth;
+    m_Builder.Reset();
+  }
+  ++m_iDepth;
+  return (bIsTable ? m_Builder.OnStartTable() : m_Builder.OnStartArray());
+}
+
+bool JsonItemHandler::EndContainer(bool bIsTable) {
+  --m_iDepth;
+  if (!m_bIsBuilding) {
+    if (m_bIsInItems && m_iDepth == m_iItemsDepth) {
+      m_bIsInItems = false;
+      m_bHasItems = true;
+    }
+    return true;
+  }
+
+  if (!(bIsTable ? m_Builder.OnEndTable() : m_Builder.OnEndArray())) {
+    return false;
+  } else if (m_iDepth > m_iBuildDepth) {
+    return true;
+  }
+  m_bIsBuilding = false;
+  if (m_bIsInItems) {
+    nE_DataPointer pItem(m_Builder.Release());
+    return OnItem(pItem->AsTable());
+  } else {
+    m_Options.Push(m_sKey, m_Builder.Release());
+    return true;
+  }
+}
+
+}
+}
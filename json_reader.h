@@ -0,0 +1,121 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#ifndef JSON_READER_H_6D1F3B84_C0A2_4E57_9B16_7A5E2C94D38F
+#define JSON_READER_H_6D1F3B84_C0A2_4E57_9B16_7A5E2C94D38F
+
+#include <iosfwd>
+
+namespace parts {
+namespace db {
+
+// Receives the events of JsonReader. Every callback returns false to stop
+// reading. OnValue takes ownership of the scalar value.
+class JsonHandler {
+ public:
+  virtual ~JsonHandler() {}
+  virtual bool OnStartTable() = 0;
+  virtual bool OnKey(const std::string& sKey) = 0;
+  virtual bool OnEndTable() = 0;
+  virtual bool OnStartArray() = 0;
+  virtual bool OnEndArray() = 0;
+  virtual bool OnValue(nE_Data* pValue) = 0;
+};
+
+// Reads one JSON document from a stream and reports it as events, without
+// building a data tree.
+class JsonReader {
+ public:
+  explicit JsonReader(std::istream& stream);
+  bool               Read(JsonHandler& handler);
+  const std::string& GetError() const;
+
+ private:
+  bool ReadValue(JsonHandler& handler, int iDepth);
+  bool ReadTable(JsonHandler& handler, int iDepth);
+  bool ReadArray(JsonHandler& handler, int iDepth);
+  bool ReadString(std::string& sValue);
+  bool ReadNumber(JsonHandler& handler);
+  bool ReadLiteral(JsonHandler& handler);
+  bool ReadHex(unsigned& iValue);
+  int  Peek();
+  int  Next();
+  void SkipSpaces();
+  bool Fail(const char* sMessage);
+
+ private:
+  std::streambuf* m_pBuffer;
+  size_t          m_iOffset;
+  std::string     m_sError;
+};
+
+// Builds a data tree from the events, one value at a time.
+class JsonDataBuilder : public JsonHandler {
+ public:
+  JsonDataBuilder();
+  virtual ~JsonDataBuilder();
+  void     Reset();
+  nE_Data* Release();
+
+  virtual bool OnStartTable();
+  virtual bool OnKey(const std::string& sKey);
+  virtual bool OnEndTable();
+  virtual bool OnStartArray();
+  virtual bool OnEndArray();
+  virtual bool OnValue(nE_Data* pValue);
+
+ private:
+  JsonDataBuilder(const JsonDataBuilder& builder);
+  JsonDataBuilder& operator=(const JsonDataBuilder& builder);
+
+ private:
+  nE_Data*              m_pRoot;
+  std::vector<nE_Data*> m_vContainers;
+  std::string           m_sKey;
+};
+
+// Streams the items of a collection one by one. The document is either an
+// array of items or a collection table whose "items" array comes after all
+// other options; the options are reported once before the first item.
+class JsonItemHandler : public JsonHandler {
+ public:
+  JsonItemHandler();
+  bool HasItems() const;
+  bool IsItemArray() const;
+
+  virtual bool OnStartTable();
+  virtual bool OnKey(const std::string& sKey);
+  virtual bool OnEndTable();
+  virtual bool OnStartArray();
+  virtual bool OnEndArray();
+  virtual bool OnValue(nE_Data* pValue);
+
+ protected:
+  virtual bool OnOptions(const nE_DataTable* pOptions) = 0;
+  virtual bool OnItem(const nE_DataTable* pItem) = 0;
+
+ private:
+  bool StartContainer(bool bIsTable);
+  bool EndContainer(bool bIsTable);
+
+ private:
+  nE_DataTable    m_Options;
+  JsonDataBuilder m_Builder;
+  std::string     m_sKey;
+  int             m_iDepth;
+  int             m_iItemsDepth;
+  int             m_iBuildDepth;
+  bool            m_bIsInItems;
+  bool            m_bIsBuilding;
+  bool            m_bHasItems;
+  bool            m_bIsItemArray;
+};
+
+}
+}
+
+#endif//JSON_READER_H_6D1F3B84_C0A2_4E57_9B16_7A5E2C94D38F
@@ -0,0 +1,181 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#include "parts/include.h"
+#include "key_filter.h"
+#include <string.h>
+
+namespace parts {
+namespace db {
+
+namespace {
+
+const size_t BITS_PER_KEY = 10;
+const size_t HASH_COUNT = 7;
+const size_t MIN_CAPACITY = 64;
+
+uint64_t Mix(uint64_t iValue) {
+  iValue ^= iValue >> 33;
+  iValue *= 0xff51afd7ed558ccdULL;
+  iValue ^= iValue >> 33;
+  iValue *= 0xc4ceb9fe1a85ec53ULL;
+  iValue ^= iValue >> 33;
+  return iValue;
+}
+
+uint64_t HashBytes(const std::string& sValue, uint64_t iSeed) {
+  uint64_t iHash = 0xcbf29ce484222325ULL ^ iSeed;
+  for (size_t i = 0; i < sValue.size(); ++i) {
+    iHash ^= (uint8_t)sValue[i];
+    iHash *= 0x100000001b3ULL;
+  }
+  return Mix(iHash);
+}
+
+uint64_t HashNumber(double fValue) {
+  if (fValue == 0.0) {
+    fValue = 0.0;
+  }
+  uint64_t iBits = 0;
+  memcpy(&iBits, &fValue, sizeof(iBits));
+  return Mix(iBits ^ 0x6e756d626572ULL);
+}
+
+}
+
+KeyFilter::KeyFilter()
+  : m_pIndex(NULL),
+    m_iCapacity(0),
+    m_iIndexSize(0),
+    m_iKeyCount(0),
+    m_iDeletedCount(0),
+    m_iBuildCount(0),
+    m_iProbeCount(0),
+    m_iSkipCount(0),
+    m_iFalsePositiveCount(0) {}
+
+void KeyFilter::Build(const CollectionIndex* pIndex) {
+  m_pIndex = pIndex;
+  Resize(pIndex->size());
+  m_iIndexSize = pIndex->size();
+  m_iKeyCount = 0;
+  m_iDeletedCount = 0;
+  CollectionIndex::const_iterator it = pIndex->begin();
+  for (; it != pIndex->end(); ++it) {
+    Insert(Hash(it->first.get()));
+    ++m_iKeyCount;
+  }
+  ++m_iBuildCount;
+}
+
+bool KeyFilter::IsBuiltFor(const CollectionIndex* pIndex) const {
+  return (m_pIndex == pIndex && m_iIndexSize == pIndex->size());
+}
+
+bool KeyFilter::NeedsRebuild() const {
+  return (m_iKeyCount > m_iCapacity * 2 ||
+          (m_iDeletedCount > 0 && m_iDeletedCount * 4 > m_iKeyCount));
+}
+
+void KeyFilter::Add(const nE_Data* pKey, bool bIsNewItem) {
+  Insert(Hash(pKey));
+  ++m_iKeyCount;
+  if (bIsNewItem) {
+    ++m_iIndexSize;
+  }
+}
+
+void KeyFilter::Delete(size_t iCount) {
+  m_iDeletedCount += iCount;
+  m_iIndexSize -= std::min(iCount, m_iIndexSize);
+}
+
+bool KeyFilter::MayContain(const nE_Data* pKey) const {
+  ++m_iProbeCount;
+  const uint64_t iHash = Hash(pKey);
+  const uint64_t iStep = Mix(iHash ^ 0x9e3779b97f4a7c15ULL) | 1;
+  const uint64_t iMask = m_vBits.size() * 64 - 1;
+  for (size_t i = 0; i < HASH_COUNT; ++i) {
+    const uint64_t iBit = (iHash + i * iStep) & iMask;
+    if ((m_vBits[iBit >> 6] & (1ULL << (iBit & 63))) == 0) {
+      ++m_iSkipCount;
+      return false;
+    }
+  }
+  return true;
+}
+
+void KeyFilter::CountFalsePositive() const {
+  ++m_iFalsePositiveCount;
+}
+
+void KeyFilter::GetStatistics(nE_DataTable* pStatistics) const {
+  pStatistics->Push("keys", (int)m_iKeyCount);
+  pStatistics->Push("deleted", (int)m_iDeletedCount);
+  pStatistics->Push("builds", (int)m_iBuildCount);
+  pStatistics->Push("probes", (int)m_iProbeCount);
+  pStatistics->Push("skipped", (int)m_iSkipCount);
+  pStatistics->Push("false_positives", (int)m_iFalsePositiveCount);
+}
+
+uint64_t KeyFilter::Hash(const nE_Data* pKey) {
+  if (pKey == NULL) {
+    return Mix(0);
+  }
+  switch (pKey->GetType()) {
+    case nE_Data::Data_Int:
+      return HashNumber(pKey->AsInt());
+    case nE_Data::Data_Float:
+      return HashNumber(pKey->AsFloat());
+    case nE_Data::Data_String:
+      return HashBytes(pKey->AsString(), 0x73);
+    case nE_Data::Data_Array: {
+      const nE_DataArray* pArray = pKey->AsArray();
+      uint64_t iHash = Mix(pArray->Size() ^ 0x6172726179ULL);
+      for (size_t i = 0; i < pArray->Size(); ++i) {
+        iHash = Mix(iHash ^ Hash(pArray->Get(i)));
+      }
+      return iHash;
+    }
+    case nE_Data::Data_Table: {
+      // Entries are summed, so equal tables hash alike in any key order.
+      const nE_DataTable* pTable = pKey->AsTable();
+      uint64_t iHash = 0x7461626c65ULL;
+      nE_DataTableConstIterator it = pTable->Begin();
+      for (; it != pTable->End(); ++it) {
+        iHash += Mix(HashBytes(it.Key(), 0x6b) ^ Hash(it.Value()));
+      }
+      return Mix(iHash);
+    }
+    default: {
+      std::string sKey;
+      nE_DataUtils::SaveDataToJsonString(pKey, sKey, false);
+      return HashBytes(sKey, 0x6a);
+    }
+  }
+}
+
+void KeyFilter::Resize(size_t iKeyCount) {
+  m_iCapacity = std::max(iKeyCount, MIN_CAPACITY);
+  size_t iBitCount = 64;
+  while (iBitCount < m_iCapacity * BITS_PER_KEY) {
+    iBitCount <<= 1;
+  }
+  m_vBits.assign(iBitCount / 64, 0);
+}
+
+void KeyFilter::Insert(uint64_t iHash) {
+  const uint64_t iStep = Mix(iHash ^ 0x9e3779b97f4a7c15ULL) | 1;
+  const uint64_t iMask = m_vBits.size() * 64 - 1;
+  for (size_t i = 0; i < HASH_COUNT; ++i) {
+    const uint64_t iBit = (iHash + i * iStep) & iMask;
+    m_vBits[iBit >> 6] |= (1ULL << (iBit & 63));
+  }
+}
+
+}
+}
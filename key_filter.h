@@ -0,0 +1,57 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#ifndef KEY_FILTER_H_D4F1A6C2_5E38_4B97_A0C3_7B9E24F15D86
+#define KEY_FILTER_H_D4F1A6C2_5E38_4B97_A0C3_7B9E24F15D86
+
+#include "data_reference.h"
+
+namespace parts {
+namespace db {
+
+// Bloom filter over the keys of one collection index. It is consulted before
+// the index is probed, so lookups of absent keys skip the tree walk. Deleted
+// keys cannot be removed from the filter, so it asks for a rebuild once too
+// many keys were deleted or inserted since the last build. The filter also
+// counts the index entries it knows of: an insert or delete made on the
+// collection directly changes the index size and the filter is rebuilt.
+class KeyFilter {
+ public:
+  KeyFilter();
+  void            Build(const CollectionIndex* pIndex);
+  bool            IsBuiltFor(const CollectionIndex* pIndex) const;
+  bool            NeedsRebuild() const;
+  void            Add(const nE_Data* pKey, bool bIsNewItem);
+  void            Delete(size_t iCount);
+  bool            MayContain(const nE_Data* pKey) const;
+  void            CountFalsePositive() const;
+  void            GetStatistics(nE_DataTable* pStatistics) const;
+  static uint64_t Hash(const nE_Data* pKey);
+
+ private:
+  void            Resize(size_t iKeyCount);
+  void            Insert(uint64_t iHash);
+
+ private:
+  const CollectionIndex* m_pIndex;
+  std::vector<uint64_t>  m_vBits;
+  size_t                 m_iCapacity;
+  size_t                 m_iIndexSize;
+  size_t                 m_iKeyCount;
+  size_t                 m_iDeletedCount;
+  size_t                 m_iBuildCount;
+  mutable size_t         m_iProbeCount;
+  mutable size_t         m_iSkipCount;
+  mutable size_t         m_iFalsePositiveCount;
+};
+
+typedef std::shared_ptr<KeyFilter> KeyFilterPointer;
+
+}
+}
+
+#endif//KEY_FILTER_H_D4F1A6C2_5E38_4B97_A0C3_7B9E24F15D86
@@ -0,0 +1,206 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#include "parts/include.h"
+#include "materialized_view.h"
+#include "query_context.h"
+#include "collection.h"
+#include "query.h"
+
+namespace parts {
+namespace db {
+
+MaterializedView::MaterializedView()
+  : m_bIsChanged(false) {}
+
+bool MaterializedView::Parse(const nE_DataTable* pQueryTable,
+                             QueryContext& queryContext,
+                             ErrorStorage& errorStorage) {
+  m_sName = nE_DataUtils::GetAsString(pQueryTable, "collection", "");
+  m_sSourceName = nE_DataUtils::GetAsString(pQueryTable, "source", "");
+  m_sAlias = nE_DataUtils::GetAsString(pQueryTable, "alias", "");
+  m_sGroupField = nE_DataUtils::GetAsString(pQueryTable, "group", "");
+  if (m_sName.empty() || m_sSourceName.empty()) {
+    errorStorage.Add("It is wrong 'create_view' query: it needs 'collection' and 'source'.");
+    return false;
+  }
+
+  const nE_Data* pResult = pQueryTable->Get("result");
+  if (pResult != NULL) {
+    if (!IsTable(pResult)) {
+      errorStorage.Add("It is wrong 'result' of a view: it must be a table.",
+                       m_sName.c_str());
+      return false;
+    }
+    m_pResult.reset(pResult->Clone());
+  }
+  if (pQueryTable->IsExist("indices")) {
+    m_pIndices.reset(pQueryTable->Get("indices")->Clone());
+  }
+  if (pQueryTable->IsExist("where")) {
+    m_pWhere.reset(new ScanFilter());
+    return m_pWhere->Parse(pQueryTable->Get("where"), queryContext,
+                           errorStorage);
+  }
+  return true;
+}
+
+const std::string& MaterializedView::GetName() const {
+  return m_sName;
+}
+
+const std::string& MaterializedView::GetSourceName() const {
+  return m_sSourceName;
+}
+
+const nE_Data* MaterializedView::GetIndices() const {
+  return m_pIndices.get();
+}
+
+void MaterializedView::Rebuild(const nE_DataArray* pSourceItems,
+                               Collection& view, QueryContext& queryContext) {
+  m_Groups.clear();
+  m_bIsChanged = true;
+  if (m_sGroupField.empty()) {
+    for (size_t i = 0; i < pSourceItems->Size(); ++i) {
+      AddItem(pSourceItems->Get(i)->AsTable(), view, queryContext);
+    }
+    return;
+  }
+
+  // Groups are counted first so every group row is inserted only once.
+  for (size_t i = 0; i < pSourceItems->Size(); ++i) {
+    const nE_DataTable* pItem = pSourceItems->Get(i)->AsTable();
+    const nE_Data* pValue = pItem->Get(m_sGroupField);
+    if (pValue != NULL && Matches(pItem)) {
+      Group& group = m_Groups[CollectionIndex::CreateKey(pValue)];
+      if (group.m_pValue ==(nE_DataPointer) NULL) {
+        group.m_pValue.reset(pValue->Clone());
+        group.m_iCount = 0;
+      }
+      ++group.m_iCount;
+    }
+  }
+  GroupMap::const_iterator it = m_Groups.begin();
+  for (; it != m_Groups.end(); ++it) {
+    nE_DataTable row;
+    row.PushCopy(Collection::DEFAULT_INDEX_NAME, it->second.m_pValue.get());
+    row.PushCopy(m_sGroupField, it->second.m_pValue.get());
+    row.Push("count", it->second.m_iCount);
+    view.InsertItem(&row);
+  }
+}
+
+void MaterializedView::AddItem(const nE_DataTable* pItem, Collection& view,
+                               QueryContext& queryContext) {
+  if (!Matches(pItem)) {
+    return;
+  }
+  if (m_sGroupField.empty()) {
+    nE_DataPointer pRow(CreateRow(pItem, queryContext));
+    if (pRow !=(nE_DataPointer) NULL) {
+      view.InsertItem(pRow->AsTable());
+      m_bIsChanged = true;
+    }
+    return;
+  }
+
+  const nE_Data* pValue = pItem->Get(m_sGroupField);
+  if (pValue == NULL) {
+    return;
+  }
+  m_bIsChanged = true;
+  Group& group = m_Groups[CollectionIndex::CreateKey(pValue)];
+  if (group.m_pValue ==(nE_DataPointer) NULL) {
+    group.m_pValue.reset(pValue->Clone());
+    group.m_iCount = 1;
+    nE_DataTable row;
+    row.PushCopy(Collection::DEFAULT_INDEX_NAME, pValue);
+    row.PushCopy(m_sGroupField, pValue);
+    row.Push("count", group.m_iCount);
+    view.InsertItem(&row);
+  } else {
+    ++group.m_iCount;
+    UpdateGroupCount(group, view);
+  }
+}
+
+void MaterializedView::RemoveItem(const nE_DataTable* pItem, Collection& view,
+                                  QueryContext& queryContext) {
+  if (!Matches(pItem)) {
+    return;
+  }
+  if (m_sGroupField.empty()) {
+    const nE_Data* pKey = pItem->Get(Collection::DEFAULT_INDEX_NAME);
+    if (pKey != NULL) {
+      view.DeleteItem(pKey);
+      m_bIsChanged = true;
+    }
+    return;
+  }
+
+  const nE_Data* pValue = pItem->Get(m_sGroupField);
+  if (pValue == NULL) {
+    return;
+  }
+  GroupMap::iterator it = m_Groups.find(CollectionIndex::CreateKey(pValue));
+  if (it == m_Groups.end()) {
+    return;
+  }
+  m_bIsChanged = true;
+  if (--it->second.m_iCount > 0) {
+    UpdateGroupCount(it->second, view);
+  } else {
+    view.DeleteItem(it->second.m_pValue.get());
+    m_Groups.erase(it);
+  }
+}
+
+bool MaterializedView::IsChanged() const {
+  return m_bIsChanged;
+}
+
+void MaterializedView::ResetChanges() {
+  m_bIsChanged = false;
+}
+
+bool MaterializedView::Matches(const nE_DataTable* pItem) const {
+  return (m_pWhere ==(ScanFilterPointer) NULL || m_pWhere->Match(pItem));
+}
+
+nE_Data* MaterializedView::CreateRow(const nE_DataTable* pItem,
+                                     QueryContext& queryContext) const {
+  nE_Data* pRow = NULL;
+  if (m_pResult ==(nE_DataPointer) NULL) {
+    pRow = pItem->Clone();
+  } else {
+    queryContext.Add(pItem);
+    queryContext.Add(m_sAlias, pItem);
+    pRow = queryContext.CalculateValue(m_pResult.get(), m_sAlias);
+    queryContext.Remove(m_sAlias);
+    queryContext.Remove(pItem);
+  }
+  if (!IsTable(pRow)) {
+    delete pRow;
+    return NULL;
+  }
+  const nE_Data* pKey = pItem->Get(Collection::DEFAULT_INDEX_NAME);
+  if (pKey != NULL) {
+    pRow->AsTable()->PushCopy(Collection::DEFAULT_INDEX_NAME, pKey);
+  }
+  return pRow;
+}
+
+void MaterializedView::UpdateGroupCount(const Group& group,
+                                        Collection& view) const {
+  nE_DataTable updateSet;
+  updateSet.Push("count", group.m_iCount);
+  view.UpdateItem(group.m_pValue.get(), &updateSet);
+}
+
+}
+}
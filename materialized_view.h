@@ -0,0 +1,79 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#ifndef MATERIALIZED_VIEW_H_2F8A61C7_93D4_4B0E_A5C2_D71E6B38F049
+#define MATERIALIZED_VIEW_H_2F8A61C7_93D4_4B0E_A5C2_D71E6B38F049
+
+#include "data_reference.h"
+#include "scan_filter.h"
+
+namespace parts {
+namespace db {
+
+class Collection;
+class QueryContext;
+class ErrorStorage;
+
+// A writable collection derived from a source collection:
+//   {"query": "create_view", "collection": "owned", "source": "inventory",
+//    "alias": "item", "where": <where>, "result": {...}, "indices": {...}}
+// Every matching source item has a row with the same primary key built from
+// 'result'. With "group": "<field>" there is one row per distinct value of
+// the source field instead, holding the number of matching items in
+// "count". Rows are changed item by item as the source changes. The source
+// must not be a view itself.
+class MaterializedView {
+ public:
+  MaterializedView();
+  bool                Parse(const nE_DataTable* pQueryTable,
+                            QueryContext& queryContext,
+                            ErrorStorage& errorStorage);
+  const std::string&  GetName() const;
+  const std::string&  GetSourceName() const;
+  const nE_Data*      GetIndices() const;
+  void                Rebuild(const nE_DataArray* pSourceItems,
+                              Collection& view, QueryContext& queryContext);
+  void                AddItem(const nE_DataTable* pItem, Collection& view,
+                              QueryContext& queryContext);
+  void                RemoveItem(const nE_DataTable* pItem, Collection& view,
+                                 QueryContext& queryContext);
+  bool                IsChanged() const;
+  void                ResetChanges();
+
+ private:
+  struct Group {
+    nE_DataPointer m_pValue;
+    int            m_iCount;
+  };
+
+  typedef std::map<nE_DataPointer, Group, CollectionIndex::key_compare>
+  GroupMap;
+
+ private:
+  bool     Matches(const nE_DataTable* pItem) const;
+  nE_Data* CreateRow(const nE_DataTable* pItem,
+                     QueryContext& queryContext) const;
+  void     UpdateGroupCount(const Group& group, Collection& view) const;
+
+ private:
+  std::string       m_sName;
+  std::string       m_sSourceName;
+  std::string       m_sAlias;
+  std::string       m_sGroupField;
+  nE_DataPointer    m_pResult;
+  nE_DataPointer    m_pIndices;
+  ScanFilterPointer m_pWhere;
+  GroupMap          m_Groups;
+  bool              m_bIsChanged;
+};
+
+typedef std::shared_ptr<MaterializedView> MaterializedViewPointer;
+
+}
+}
+
+#endif//MATERIALIZED_VIEW_H_2F8A61C7_93D4_4B0E_A5C2_D71E6B38F049
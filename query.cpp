@@ -28,9 +28,19 @@ nE_DataPointer Query::Execute(const nE_Data* pQueryData) {
   } else {
     const nE_DataTable* pQueryTable = pQueryData->AsTable();
 
+    const std::string sQueryType(nE_DataUtils::GetAsString(pQueryTable,
+                                 "query", ""));
     ParsedQuery parsedQuery(m_pQueryContext);
-    if (parsedQuery.Parse(pQueryTable, *m_pDatabase,
-                          m_pQueryContext->GetErrorStorage())) {
+    if (sQueryType == "join") {
+      pResult.reset(Join(pQueryTable));
+    } else if (sQueryType == "create_view") {
+      pResult.reset(CreateView(pQueryTable));
+    } else if (parsedQuery.Parse(pQueryTable, *m_pDatabase,
+                                 m_pQueryContext->GetErrorStorage()) &&
+               parsedQuery.ParseWhere(pQueryTable,
+                                      m_pQueryContext->GetErrorStorage()) &&
+               parsedQuery.ParseInclude(pQueryTable,
+                                        m_pQueryContext->GetErrorStorage())) {
       if (parsedQuery.m_sQueryType == "find") {
         pResult.reset(Find(parsedQuery));
       } else if (parsedQuery.m_sQueryType == "find_all") {
@@ -58,6 +68,33 @@ nE_DataPointer Query::Execute(const nE_Data* pQueryData) {
   return pResult;
 }
 
+bool Query::ParsedQuery::ParseWhere(const nE_DataTable* pQueryTable,
+                                    ErrorStorage& errorStorage) {
+  m_pWhere.reset();
+  if (!pQueryTable->IsExist("where")) {
+    return true;
+  }
+  m_pWhere.reset(new ScanFilter());
+  return m_pWhere->Parse(pQueryTable->Get("where"), *m_pQueryContext,
+                         errorStorage);
+}
+
+bool Query::ParsedQuery::ParseInclude(const nE_DataTable* pQueryTable,
+                                      ErrorStorage& errorStorage) {
+  m_pInclude = NULL;
+  if (!pQueryTable->IsExist("include")) {
+    return true;
+  }
+  const nE_Data* pInclude = pQueryTable->Get("include");
+  if (!IsTable(pInclude)) {
+    errorStorage.Add("It is wrong 'include': it must be a table of field arrays.",
+                     m_sCollectionName.c_str());
+    return false;
+  }
+  m_pInclude = pInclude->AsTable();
+  return true;
+}
+
 bool Query::MayBeQueryTable(const nE_Data* pQueryTable) {
   if (pQueryTable == NULL) {
     return false;
@@ -96,42 +133,173 @@ nE_Data* Query::FindAll(const ParsedQuery& parsedQuery, size_t iLimit) {
   ItemVector items;
   FindItems(parsedQuery, iLimit, items);
 
+  CoveringIndexPointer pCoveringIndex = m_pDatabase->GetCoveringIndex(
+                                          parsedQuery.m_sCollectionName,
+                                          GetIndexName(parsedQuery),
+                                          parsedQuery.m_pIndex,
+                                          parsedQuery.m_pResult,
+                                          parsedQuery.m_sAlias);
+
   nE_DataArray* pResult = new nE_DataArray();
   ItemVector::iterator it = items.begin();
   for (; it != items.end(); ++it) {
-    pResult->Push(FindResult(parsedQuery, *it));
+    const nE_DataTable* pItem = *it;
+    if (pCoveringIndex !=(CoveringIndexPointer) NULL) {
+      pItem = pCoveringIndex->GetEntry(pItem);
+    }
+    pResult->Push(FindResult(parsedQuery, pItem));
   }
 
   return pResult;
 }
 
+nE_Data* Query::JoinResult(const ParsedQuery& outerQuery,
+                           const ParsedQuery& innerQuery, const nE_Data* pResult,
+                           const nE_Data* pOuterItem, const nE_Data* pInnerItem) {
+  m_pQueryContext->Add(pInnerItem->AsTable());
+  m_pQueryContext->Add(outerQuery.m_sAlias, pOuterItem);
+  m_pQueryContext->Add(innerQuery.m_sAlias, pInnerItem);
+  nE_Data* pJoinResult = m_pQueryContext->CalculateValue(pResult,
+                         innerQuery.m_sAlias);
+  m_pQueryContext->Remove(innerQuery.m_sAlias);
+  m_pQueryContext->Remove(outerQuery.m_sAlias);
+  m_pQueryContext->Remove(pInnerItem->AsTable());
+  return pJoinResult;
+}
+
+nE_Data* Query::Join(const nE_DataTable* pQueryTable) {
+  ParsedQuery outerQuery(m_pQueryContext);
+  ParsedQuery innerQuery(m_pQueryContext);
+  nE_DataTable innerQueryTable;
+  if (!ParseJoin(pQueryTable, outerQuery, innerQuery, innerQueryTable)) {
+    return NULL;
+  }
+
+  ItemVector outerItems;
+  FindItems(outerQuery, (outerQuery.m_sQueryType == "find" ? 1 : INT_MAX),
+            outerItems);
+
+  JoinProbeVector probes;
+  probes.reserve(outerItems.size());
+  const nE_Data* pKey = pQueryTable->Get("key");
+  for (size_t i = 0; i < outerItems.size(); ++i) {
+    m_pQueryContext->Add(outerItems[i]);
+    m_pQueryContext->Add(outerQuery.m_sAlias, outerItems[i]);
+    nE_DataPointer pKeyValue(m_pQueryContext->CalculateValue(pKey,
+                             outerQuery.m_sAlias, false));
+    m_pQueryContext->Remove(outerQuery.m_sAlias);
+    m_pQueryContext->Remove(outerItems[i]);
+    if (pKeyValue !=(nE_DataPointer) NULL) {
+      JoinProbe probe;
+      probe.m_pKey = CollectionIndex::CreateKey(pKeyValue.get());
+      probe.m_iOuterItem = i;
+      probes.push_back(probe);
+    }
+  }
+
+  std::vector<ItemVector> innerItems(outerItems.size());
+  ProbeJoin(innerQuery, probes, innerItems);
+
+  const bool bIsLeftJoin = (nE_DataUtils::GetAsString(pQueryTable, "type",
+                            "inner") == "left");
+  const nE_Data* pResult = pQueryTable->Get("result");
+  nE_DataTable emptyItem;
+  nE_DataArray* pJoinResult = new nE_DataArray();
+  for (size_t i = 0; i < outerItems.size(); ++i) {
+    const ItemVector& items = innerItems[i];
+    for (size_t j = 0; j < items.size(); ++j) {
+      pJoinResult->Push(JoinResult(outerQuery, innerQuery, pResult,
+                                   outerItems[i], items[j]));
+    }
+    if (items.empty() && bIsLeftJoin) {
+      pJoinResult->Push(JoinResult(outerQuery, innerQuery, pResult,
+                                   outerItems[i], &emptyItem));
+    }
+  }
+  return pJoinResult;
+}
+
 nE_Data* Query::Insert(const ParsedQuery& parsedQuery) {
   if (parsedQuery.m_pValue->GetType() == nE_Data::Data_Array) {
     nE_DataArray arrayToInsert = parsedQuery.m_pValue->AsArray();
     for (size_t i = 0; i < arrayToInsert.Size(); i++) {
       nE_DataPointer pResult(m_pQueryContext->CalculateValue(arrayToInsert.Get(
                                i)->AsTable(), parsedQuery.m_sAlias, false));
-      parsedQuery.m_pCollection->InsertItem(pResult->AsTable());
+      InsertItem(parsedQuery, pResult->AsTable());
     }
   } else {
     nE_DataPointer pResult(m_pQueryContext->CalculateValue(parsedQuery.m_pValue,
                            parsedQuery.m_sAlias, false));
-    parsedQuery.m_pCollection->InsertItem(pResult->AsTable());
+    InsertItem(parsedQuery, pResult->AsTable());
   }
+  m_pDatabase->OnCollectionChanged(parsedQuery.m_sCollectionName, false);
   SendCollectionUpdated(parsedQuery);
+  m_pDatabase->CompleteViews(parsedQuery.m_sCollectionName);
   return new nE_DataInt(1);
 }
 
+void Query::InsertItem(const ParsedQuery& parsedQuery,
+                       const nE_DataTable* pItem) {
+  parsedQuery.m_pCollection->InsertItem(pItem);
+  m_pDatabase->AddToKeyFilters(parsedQuery.m_sCollectionName, pItem, false);
+  if (m_pDatabase->HasViews(parsedQuery.m_sCollectionName)) {
+    const nE_DataTable* pStoredItem = FindStoredItem(parsedQuery,
+                                      pItem->Get(Collection::DEFAULT_INDEX_NAME));
+    if (pStoredItem != NULL) {
+      m_pDatabase->AddToViews(parsedQuery.m_sCollectionName, pStoredItem,
+                              *m_pQueryContext);
+    }
+  }
+}
+
 void Query::UpdateItem(const ParsedQuery& parsedQuery,
                        const nE_Data* pCollectionItem) {
   m_pQueryContext->Add(pCollectionItem->AsTable());
   m_pQueryContext->Add(parsedQuery.m_sAlias, pCollectionItem);
   nE_DataPointer pUpdateSet(m_pQueryContext->CalculateValue(parsedQuery.m_pSet,
                             parsedQuery.m_sAlias, false));
-  parsedQuery.m_pCollection->UpdateItem(pCollectionItem->AsTable()->Get(
-                                          Collection::DEFAULT_INDEX_NAME), pUpdateSet->AsTable());
+  // The item may change in place, so the views forget the old values before
+  // the update and learn the new ones from the stored item afterwards.
+  const nE_Data* pItemKey = pCollectionItem->AsTable()->Get(
+                             Collection::DEFAULT_INDEX_NAME);
+  nE_DataPointer pKey(pItemKey != NULL ? pItemKey->Clone() : NULL);
+  const bool bHasViews = m_pDatabase->HasViews(parsedQuery.m_sCollectionName);
+  if (bHasViews) {
+    m_pDatabase->RemoveFromViews(parsedQuery.m_sCollectionName,
+                                 pCollectionItem->AsTable(), *m_pQueryContext);
+  }
+  m_pDatabase->RemoveFromCoveringIndices(parsedQuery.m_sCollectionName,
+                                         pCollectionItem);
+  parsedQuery.m_pCollection->UpdateItem(pKey.get(), pUpdateSet->AsTable());
+  m_pDatabase->AddToKeyFilters(parsedQuery.m_sCollectionName,
+                               pUpdateSet->AsTable(), true);
   m_pQueryContext->Remove(parsedQuery.m_sAlias);
   m_pQueryContext->Remove(pCollectionItem->AsTable());
+  if (bHasViews && pKey !=(nE_DataPointer) NULL) {
+    const nE_DataTable* pStoredItem = FindStoredItem(parsedQuery, pKey.get());
+    if (pStoredItem != NULL) {
+      m_pDatabase->AddToViews(parsedQuery.m_sCollectionName, pStoredItem,
+                              *m_pQueryContext);
+    }
+  }
+}
+
+// Collection keeps its own copy of an item, with the primary key it may have
+// assigned and with nested and expression updates applied, so the views are
+// fed from that copy. An assigned primary key is the largest one.
+const nE_DataTable* Query::FindStoredItem(const ParsedQuery& parsedQuery,
+    const nE_Data* pKey) {
+  ReadonlyCollectionIndexPointer pIndex = parsedQuery.m_pCollection->GetIndex(
+      Collection::DEFAULT_INDEX_NAME);
+  if (pIndex ==(ReadonlyCollectionIndexPointer) NULL || pIndex->empty()) {
+    return NULL;
+  }
+  if (pKey == NULL) {
+    return pIndex->rbegin()->second->AsTable();
+  }
+  CollectionIndex::const_iterator it = pIndex->find(CollectionIndex::CreateKey(
+                                         pKey));
+  return (it != pIndex->end() ? it->second->AsTable() : NULL);
 }
 
 nE_Data* Query::Update(const ParsedQuery& parsedQuery) {
@@ -146,7 +314,9 @@ nE_Data* Query::UpdateAll(const ParsedQuery& parsedQuery, size_t iLimit) {
   for (; it != items.end(); ++it) {
     UpdateItem(parsedQuery, *it);
   }
+  m_pDatabase->OnCollectionChanged(parsedQuery.m_sCollectionName, false);
   SendCollectionUpdated(parsedQuery);
+  m_pDatabase->CompleteViews(parsedQuery.m_sCollectionName);
   return new nE_DataInt((int)items.size());
 }
 
@@ -162,10 +332,18 @@ nE_Data* Query::DeleteAll(const ParsedQuery& parsedQuery,
   ItemVector::iterator it = items.begin();
   for (; it != items.end(); ++it) {
     const nE_Data* pCollectionItem = *it;
+    m_pDatabase->RemoveFromViews(parsedQuery.m_sCollectionName,
+                                 pCollectionItem->AsTable(), *m_pQueryContext);
+    m_pDatabase->RemoveFromCoveringIndices(parsedQuery.m_sCollectionName,
+                                           pCollectionItem);
     parsedQuery.m_pCollection->DeleteItem(pCollectionItem->AsTable()->Get(
                                             Collection::DEFAULT_INDEX_NAME));
   }
+  m_pDatabase->DeleteFromKeyFilters(parsedQuery.m_sCollectionName,
+                                    items.size());
+  m_pDatabase->OnCollectionChanged(parsedQuery.m_sCollectionName, false);
   SendCollectionUpdated(parsedQuery);
+  m_pDatabase->CompleteViews(parsedQuery.m_sCollectionName);
   return new nE_DataInt((int)items.size());
 }
 
@@ -176,14 +354,29 @@ nE_Data* Query::Create(const ParsedQuery& parsedQuery) {
   collectionOptions.PushCopy("indices", parsedQuery.m_pIndices);
   collectionOptions.PushCopy("crypts", parsedQuery.m_pCrypts);
   collectionOptions.PushCopy("items", parsedQuery.m_pItems);
+  if (parsedQuery.m_pInclude != NULL) {
+    collectionOptions.PushCopy("include", parsedQuery.m_pInclude);
+  }
   m_pDatabase->CreateWritableCollection(nE_DataPointer(
                                           collectionOptions.Clone()));
   return new nE_DataBool(bCreated);
 }
 
+nE_Data* Query::CreateView(const nE_DataTable* pQueryTable) {
+  MaterializedViewPointer pView(new MaterializedView());
+  if (!pView->Parse(pQueryTable, *m_pQueryContext,
+                    m_pQueryContext->GetErrorStorage()) ||
+      !m_pDatabase->CreateView(pView, *m_pQueryContext)) {
+    return NULL;
+  }
+  return new nE_DataBool(true);
+}
+
 nE_Data* Query::CreateIfNotExists(const ParsedQuery& parsedQuery) {
   nE_Data* pIsCreated;
-  if (m_pDatabase->GetCollection(parsedQuery.m_sCollectionName) ==(CollectionPointer) NULL) {
+  if (parsedQuery.m_pCollection ==(CollectionPointer) NULL &&
+      m_pDatabase->GetCollection(parsedQuery.m_sCollectionName) ==
+      (CollectionPointer) NULL) {
     pIsCreated = Create(parsedQuery);
   } else {
     pIsCreated = new nE_DataBool(true);
@@ -191,60 +384,118 @@ nE_Data* Query::CreateIfNotExists(const ParsedQuery& parsedQuery) {
   return pIsCreated;
 }
 
+Query::ItemCollector::ItemCollector(const ScanFilter* pWhere, size_t iLimit,
+                                    ItemVector& items)
+  : m_pWhere(pWhere),
+    m_iLimit(iLimit),
+    m_Items(items) {}
+
+bool Query::ItemCollector::IsFull() const {
+  return (m_Items.size() >= m_iLimit);
+}
+
+void Query::ItemCollector::Add(const nE_DataTable* pItem) {
+  if (m_pWhere == NULL) {
+    m_Items.push_back(pItem);
+    return;
+  }
+  // Small limits take small batches, so a 'find' does not read a whole
+  // batch of items past its first match.
+  m_vBatch.push_back(pItem);
+  if (m_vBatch.size() >= std::min(ScanFilter::BATCH_SIZE,
+                                  std::max<size_t>(m_iLimit - m_Items.size(), 16))) {
+    Flush();
+  }
+}
+
+void Query::ItemCollector::Flush() {
+  if (m_vBatch.empty()) {
+    return;
+  }
+  m_pWhere->Filter(m_vBatch, m_iLimit - m_Items.size());
+  m_Items.insert(m_Items.end(), m_vBatch.begin(), m_vBatch.end());
+  m_vBatch.clear();
+}
+
 void Query::FindItems(const ParsedQuery& parsedQuery, size_t iLimit,
                       ItemVector& items) {
   const nE_DataTable* pCriteria = parsedQuery.m_pCriteria;
+  if (pCriteria == NULL && parsedQuery.m_pWhere !=(ScanFilterPointer) NULL &&
+      FindAllColumnScan(parsedQuery, iLimit, items)) {
+    return;
+  }
+
+  ItemCollector collector(parsedQuery.m_pWhere.get(), iLimit, items);
   if (pCriteria == NULL) {
-    FindAllAll(parsedQuery.m_pIndex, iLimit, items);
+    FindAllAll(parsedQuery.m_pIndex, collector);
   } else {
     if (pCriteria->IsExist("like")) {
-      FindAllLike(parsedQuery.m_pIndex, iLimit, pCriteria->Get("like"), items);
+      FindAllLike(parsedQuery.m_pIndex, GetKeyFilter(parsedQuery),
+                  pCriteria->Get("like"), collector);
     } else if (pCriteria->IsExist("min") && pCriteria->IsExist("max")) {
-      FindAllMinMax(parsedQuery.m_pIndex, iLimit, pCriteria->Get("min"),
-                    pCriteria->Get("max"), items);
+      // Without a column store a 'field' is ignored, as it always was.
+      if (!pCriteria->IsExist("field") ||
+          !FindAllColumnRange(parsedQuery, iLimit, pCriteria->Get("field"),
+                              pCriteria->Get("min"), pCriteria->Get("max"),
+                              items)) {
+        FindAllMinMax(parsedQuery.m_pIndex, pCriteria->Get("min"),
+                      pCriteria->Get("max"), collector);
+      }
     } else if (pCriteria->IsExist("exists_in")) {
-      FindAllIn(parsedQuery.m_pIndex, iLimit, pCriteria->Get("exists_in"), items);
+      FindAllIn(parsedQuery.m_pIndex, GetKeyFilter(parsedQuery),
+                pCriteria->Get("exists_in"), collector);
     } else {
       m_pQueryContext->GetErrorStorage().Add("It is wrong criteria for 'find_all' query.");
     }
   }
+  collector.Flush();
 }
 
-void Query::FindAllAll(ReadonlyCollectionIndexPointer pIndex, size_t iLimit,
-                       ItemVector& items) {
+void Query::FindAllAll(ReadonlyCollectionIndexPointer pIndex,
+                       ItemCollector& collector) {
   CollectionIndex::const_iterator it = pIndex->begin();
-  for (; it != pIndex->end() && iLimit > 0; ++it, --iLimit) {
-    items.push_back(it->second->AsTable());
+  for (; it != pIndex->end() && !collector.IsFull(); ++it) {
+    collector.Add(it->second->AsTable());
   }
 }
 
-void Query::FindAllLike(ReadonlyCollectionIndexPointer pIndex, size_t iLimit,
-                        const nE_Data* pLike, ItemVector& items) {
+void Query::FindAllLike(ReadonlyCollectionIndexPointer pIndex,
+                        KeyFilterPointer pKeyFilter, const nE_Data* pLike,
+                        ItemCollector& collector) {
   nE_DataPointer pLikeKey = CollectionIndex::CreateKey(m_pQueryContext->Evaluate(
                               pLike));
+  if (pKeyFilter !=(KeyFilterPointer) NULL &&
+      !pKeyFilter->MayContain(pLikeKey.get())) {
+    return;
+  }
   CollectionIndex::const_iterator it = pIndex->find(pLikeKey);
-  for (; it != pIndex->end() && iLimit > 0; ++it, --iLimit) {
+  if (pKeyFilter !=(KeyFilterPointer) NULL && it == pIndex->end()) {
+    pKeyFilter->CountFalsePositive();
+  }
+  for (; it != pIndex->end() && !collector.IsFull(); ++it) {
     if (*pLikeKey == *it->first) {
-      items.push_back(it->second->AsTable());
+      collector.Add(it->second->AsTable());
     } else {
       break;
     }
   }
 }
 
-void Query::FindAllMinMax(ReadonlyCollectionIndexPointer pIndex, size_t iLimit,
-                          const nE_Data* pMin, const nE_Data* pMax, ItemVector& items) {
+void Query::FindAllMinMax(ReadonlyCollectionIndexPointer pIndex,
+                          const nE_Data* pMin, const nE_Data* pMax,
+                          ItemCollector& collector) {
   CollectionIndex::const_iterator it = pIndex->lower_bound(
                                          CollectionIndex::CreateKey(m_pQueryContext->Evaluate(pMin)));
   CollectionIndex::const_iterator end = pIndex->upper_bound(
                                           CollectionIndex::CreateKey(m_pQueryContext->Evaluate(pMax)));
-  for (; it != end && iLimit > 0; ++it, --iLimit) {
-    items.push_back(it->second->AsTable());
+  for (; it != end && !collector.IsFull(); ++it) {
+    collector.Add(it->second->AsTable());
   }
 }
 
-void Query::FindAllIn(ReadonlyCollectionIndexPointer pIndex, size_t iLimit,
-                      nE_Data* pIn, ItemVector& items) {
+void Query::FindAllIn(ReadonlyCollectionIndexPointer pIndex,
+                      KeyFilterPointer pKeyFilter, nE_Data* pIn,
+                      ItemCollector& collector) {
   nE_DataPointer pTemporaryResult;
   nE_DataArray* pInArray = NULL;
   if (pIn->GetType() == nE_Data::Data_Array) {
@@ -258,12 +509,17 @@ void Query::FindAllIn(ReadonlyCollectionIndexPointer pIndex, size_t iLimit,
   }
 
   if (pInArray != NULL) {
-    for (size_t i = 0; i < pInArray->Size() && iLimit > 0; ++i) {
-      CollectionIndex::const_iterator it = pIndex->find(CollectionIndex::CreateKey(
-                                             pInArray->Get(i)));
+    for (size_t i = 0; i < pInArray->Size() && !collector.IsFull(); ++i) {
+      nE_DataPointer pKey = CollectionIndex::CreateKey(pInArray->Get(i));
+      if (pKeyFilter !=(KeyFilterPointer) NULL &&
+          !pKeyFilter->MayContain(pKey.get())) {
+        continue;
+      }
+      CollectionIndex::const_iterator it = pIndex->find(pKey);
       if (it != pIndex->end()) {
-        items.push_back(it->second->AsTable());
-        --iLimit;
+        collector.Add(it->second->AsTable());
+      } else if (pKeyFilter !=(KeyFilterPointer) NULL) {
+        pKeyFilter->CountFalsePositive();
       }
     }
   } else {
@@ -271,11 +527,214 @@ void Query::FindAllIn(ReadonlyCollectionIndexPointer pIndex, size_t iLimit,
   }
 }
 
+bool Query::ParseJoin(const nE_DataTable* pQueryTable,
+                      ParsedQuery& outerQuery, ParsedQuery& innerQuery,
+                      nE_DataTable& innerQueryTable) {
+  ErrorStorage& errorStorage = m_pQueryContext->GetErrorStorage();
+  const nE_Data* pOuter = pQueryTable->Get("outer");
+  const nE_Data* pInner = pQueryTable->Get("inner");
+  if (!MayBeQueryTable(pOuter) || !IsTable(pInner) ||
+      !pQueryTable->IsExist("key") || !pQueryTable->IsExist("result")) {
+    errorStorage.Add("It is wrong 'join' query: it needs 'outer', 'inner', 'key' and 'result'.");
+    return false;
+  }
+
+  const std::string sOuterType(nE_DataUtils::GetAsString(pOuter->AsTable(),
+                               "query", ""));
+  if (sOuterType != "find" && sOuterType != "find_all") {
+    errorStorage.Add("It is wrong 'outer': it must be a 'find' or 'find_all' query.");
+    return false;
+  }
+  if (!outerQuery.Parse(pOuter->AsTable(), *m_pDatabase, errorStorage) ||
+      !outerQuery.ParseWhere(pOuter->AsTable(), errorStorage) ||
+      !outerQuery.ParseInclude(pOuter->AsTable(), errorStorage)) {
+    return false;
+  }
+
+  // The inner side is parsed as a plain 'find_all' so it resolves the
+  // collection and the index exactly as a separate query would. The probe
+  // key takes the place of its criteria; a 'where' filters the matches.
+  if (pInner->AsTable()->IsExist("criteria")) {
+    errorStorage.Add("It is wrong 'join' query: 'inner' cannot have 'criteria', use 'where'.");
+    return false;
+  }
+  nE_DataTableConstIterator it = pInner->AsTable()->Begin();
+  for (; it != pInner->AsTable()->End(); ++it) {
+    innerQueryTable.PushCopy(it.Key(), it.Value());
+  }
+  innerQueryTable.Push("query", "find_all");
+  innerQueryTable.PushCopy("result", pQueryTable->Get("result"));
+  if (!innerQuery.Parse(&innerQueryTable, *m_pDatabase, errorStorage) ||
+      !innerQuery.ParseWhere(&innerQueryTable, errorStorage)) {
+    return false;
+  }
+  if (innerQuery.m_sAlias.empty() || innerQuery.m_sAlias == outerQuery.m_sAlias) {
+    errorStorage.Add("It is wrong 'join' query: 'outer' and 'inner' need different aliases.",
+                     innerQuery.m_sCollectionName.c_str());
+    return false;
+  }
+  return true;
+}
+
+void Query::ProbeJoin(const ParsedQuery& innerQuery, JoinProbeVector& probes,
+                      std::vector<ItemVector>& innerItems) {
+  // Probing in key order lets repeated keys reuse the previous range and
+  // every distinct key start from where that range ended: a few steps forward
+  // reach it when the keys are dense, and only a longer jump searches the
+  // index from the root.
+  ReadonlyCollectionIndexPointer pIndex = innerQuery.m_pIndex;
+  CollectionIndex::key_compare keyLess = pIndex->key_comp();
+  std::stable_sort(probes.begin(), probes.end(),
+                   [&keyLess](const JoinProbe& left, const JoinProbe& right) {
+    return keyLess(left.m_pKey, right.m_pKey);
+  });
+
+  const size_t MAX_PROBE_STEPS = 8;
+  KeyFilterPointer pKeyFilter = GetKeyFilter(innerQuery);
+  CollectionIndex::const_iterator itBegin = pIndex->end();
+  CollectionIndex::const_iterator itEnd = pIndex->end();
+  CollectionIndex::const_iterator itNext = pIndex->begin();
+  nE_DataPointer pLastKey;
+  JoinProbeVector::const_iterator itProbe = probes.begin();
+  for (; itProbe != probes.end(); ++itProbe) {
+    if (pLastKey ==(nE_DataPointer) NULL || keyLess(pLastKey, itProbe->m_pKey)) {
+      pLastKey = itProbe->m_pKey;
+      if (pKeyFilter !=(KeyFilterPointer) NULL &&
+          !pKeyFilter->MayContain(itProbe->m_pKey.get())) {
+        itBegin = itEnd = pIndex->end();
+        continue;
+      }
+      size_t iStep = 0;
+      while (itNext != pIndex->end() && keyLess(itNext->first, itProbe->m_pKey) &&
+             iStep < MAX_PROBE_STEPS) {
+        ++itNext;
+        ++iStep;
+      }
+      if (itNext != pIndex->end() && keyLess(itNext->first, itProbe->m_pKey)) {
+        itNext = pIndex->lower_bound(itProbe->m_pKey);
+      }
+      itBegin = itNext;
+      itEnd = itBegin;
+      while (itEnd != pIndex->end() && !keyLess(itProbe->m_pKey, itEnd->first)) {
+        ++itEnd;
+      }
+      itNext = itEnd;
+      if (pKeyFilter !=(KeyFilterPointer) NULL && itBegin == itEnd) {
+        pKeyFilter->CountFalsePositive();
+      }
+    }
+    ItemVector& items = innerItems[itProbe->m_iOuterItem];
+    for (CollectionIndex::const_iterator it = itBegin; it != itEnd; ++it) {
+      items.push_back(it->second->AsTable());
+    }
+  }
+
+  if (innerQuery.m_pWhere !=(ScanFilterPointer) NULL) {
+    for (size_t i = 0; i < innerItems.size(); ++i) {
+      if (!innerItems[i].empty()) {
+        innerQuery.m_pWhere->Filter(innerItems[i], INT_MAX);
+      }
+    }
+  }
+}
+
+bool Query::FindAllColumnRange(const ParsedQuery& parsedQuery, size_t iLimit,
+                               const nE_Data* pField, const nE_Data* pMin,
+                               const nE_Data* pMax, ItemVector& items) {
+  ColumnStorePointer pColumnStore = m_pDatabase->GetColumnStore(
+                                      parsedQuery.m_sCollectionName);
+  if (pColumnStore ==(ColumnStorePointer) NULL || !IsString(pField)) {
+    return false;
+  }
+
+  nE_DataPointer pMinKey = CollectionIndex::CreateKey(m_pQueryContext->Evaluate(
+                             pMin));
+  nE_DataPointer pMaxKey = CollectionIndex::CreateKey(m_pQueryContext->Evaluate(
+                             pMax));
+  const ScanFilter* pWhere = parsedQuery.m_pWhere.get();
+  ColumnStore::RowVector rows;
+  if (!pColumnStore->SelectRange(pField->AsString(), pMinKey.get(),
+                                 pMaxKey.get(), INT_MAX, rows)) {
+    m_pQueryContext->GetErrorStorage().Add(
+      "It is wrong criteria 'min'/'max' for the column type.",
+      parsedQuery.m_sCollectionName.c_str());
+    return true;
+  }
+  if (pWhere != NULL) {
+    pWhere->FilterRows(*pColumnStore, rows, INT_MAX);
+  }
+  if (!SortRowsByIndex(parsedQuery, *pColumnStore, rows, iLimit, items)) {
+    m_pQueryContext->GetErrorStorage().Add(
+      "It is wrong 'index' for criteria 'field': its field is unknown.",
+      parsedQuery.m_sCollectionName.c_str());
+  }
+  return true;
+}
+
+// A columnar collection without criteria is scanned with the 'where' filter
+// reading the columns, instead of walking the index. The surviving rows are
+// put in the order of the query's index, so the result is the same as that
+// of the index walk.
+bool Query::FindAllColumnScan(const ParsedQuery& parsedQuery, size_t iLimit,
+                              ItemVector& items) {
+  ColumnStorePointer pColumnStore = m_pDatabase->GetColumnStore(
+                                      parsedQuery.m_sCollectionName);
+  if (pColumnStore ==(ColumnStorePointer) NULL) {
+    return false;
+  }
+  ColumnStore::RowVector rows;
+  parsedQuery.m_pWhere->ScanRows(*pColumnStore, INT_MAX, rows);
+  return SortRowsByIndex(parsedQuery, *pColumnStore, rows, iLimit, items);
+}
+
+// Rows without the index field are not in the index, so they are dropped.
+bool Query::SortRowsByIndex(const ParsedQuery& parsedQuery,
+                            const ColumnStore& columnStore,
+                            const ColumnStore::RowVector& rows, size_t iLimit,
+                            ItemVector& items) {
+  std::string sField;
+  if (parsedQuery.m_pIndex ==(ReadonlyCollectionIndexPointer) NULL ||
+      !m_pDatabase->GetIndexField(parsedQuery.m_sCollectionName,
+                                  GetIndexName(parsedQuery), sField)) {
+    return false;
+  }
+  typedef std::pair<nE_DataPointer, size_t> KeyedRow;
+  std::vector<KeyedRow> keyedRows;
+  keyedRows.reserve(rows.size());
+  ColumnStore::RowVector::const_iterator it = rows.begin();
+  for (; it != rows.end(); ++it) {
+    const nE_Data* pValue = columnStore.GetRow(*it)->Get(sField);
+    if (pValue != NULL) {
+      keyedRows.push_back(KeyedRow(CollectionIndex::CreateKey(pValue), *it));
+    }
+  }
+  CollectionIndex::key_compare keyLess = parsedQuery.m_pIndex->key_comp();
+  std::stable_sort(keyedRows.begin(), keyedRows.end(),
+                   [&keyLess](const KeyedRow& left, const KeyedRow& right) {
+    return keyLess(left.first, right.first);
+  });
+  for (size_t i = 0; i < keyedRows.size() && items.size() < iLimit; ++i) {
+    items.push_back(columnStore.GetRow(keyedRows[i].second));
+  }
+  return true;
+}
+
+std::string Query::GetIndexName(const ParsedQuery& parsedQuery) {
+  if (parsedQuery.m_sIndexName.empty()) {
+    return Collection::DEFAULT_INDEX_NAME;
+  } else {
+    return parsedQuery.m_sIndexName;
+  }
+}
+
+KeyFilterPointer Query::GetKeyFilter(const ParsedQuery& parsedQuery) {
+  return m_pDatabase->GetKeyFilter(parsedQuery.m_sCollectionName,
+                                   GetIndexName(parsedQuery),
+                                   parsedQuery.m_pIndex);
+}
+
 void Query::SendCollectionUpdated(const ParsedQuery& parsedQuery) {
-  nE_DataTable collectionInfo;
-  collectionInfo.Push("collection", parsedQuery.m_sCollectionName);
-  nE_Mediator::GetInstance()->SendMessage(Messages::Event_Db_CollectionUpdated,
-                                          &collectionInfo);
+  m_pDatabase->SendCollectionUpdated(parsedQuery.m_sCollectionName);
 }
 
 }
@@ -9,6 +9,10 @@
 #define QUERY_H_44CBC845_F827_4A69_A1C5_23967A144E10
 
 #include "data_reference.h"
+#include "scan_filter.h"
+#include "key_filter.h"
+#include "covering_index.h"
+#include "materialized_view.h"
 
 namespace parts {
 namespace db {
@@ -41,6 +45,8 @@ class Query {
     const nE_DataTable*            m_pIndices;
     const nE_DataArray*            m_pCrypts;
     const nE_DataArray*            m_pItems;
+    ScanFilterPointer              m_pWhere;
+    const nE_DataTable*            m_pInclude;
 
     ParsedQuery(QueryContext* pQueryContext);
     bool Parse(const nE_DataTable* pQueryTable, Database& database,
@@ -59,11 +65,38 @@ class Query {
                      ErrorStorage& errorStorage);
     bool ParseCreate(const nE_DataTable* pQueryTable, Database& database,
                      ErrorStorage& errorStorage);
+    bool ParseWhere(const nE_DataTable* pQueryTable, ErrorStorage& errorStorage);
+    bool ParseInclude(const nE_DataTable* pQueryTable,
+                      ErrorStorage& errorStorage);
   };
 
  private:
   typedef std::vector<const nE_DataTable*> ItemVector;
 
+  struct JoinProbe {
+    nE_DataPointer m_pKey;
+    size_t         m_iOuterItem;
+  };
+
+  typedef std::vector<JoinProbe> JoinProbeVector;
+
+  // Takes the items of the criteria walk up to the limit. With a 'where'
+  // filter the items are filtered batch by batch as they come, so the walk
+  // stops as soon as enough items match.
+  class ItemCollector {
+   public:
+    ItemCollector(const ScanFilter* pWhere, size_t iLimit, ItemVector& items);
+    bool IsFull() const;
+    void Add(const nE_DataTable* pItem);
+    void Flush();
+
+   private:
+    const ScanFilter* m_pWhere;
+    size_t            m_iLimit;
+    ItemVector&       m_Items;
+    ItemVector        m_vBatch;
+  };
+
  private:
   nE_Data* Find(const ParsedQuery& parsedQuery);
   nE_Data* FindAll(const ParsedQuery& parsedQuery, size_t iLimit = INT_MAX);
@@ -74,24 +107,49 @@ class Query {
   nE_Data* DeleteAll(const ParsedQuery& parsedQuery, size_t iLimit = INT_MAX);
   nE_Data* Create(const ParsedQuery& parsedQuery);
   nE_Data* CreateIfNotExists(const ParsedQuery& parsedQuery);
+  nE_Data* Join(const nE_DataTable* pQueryTable);
+  nE_Data* CreateView(const nE_DataTable* pQueryTable);
 
  private:
   void FindItems(const ParsedQuery& parsedQuery, size_t iLimit,
                  ItemVector& items);
-  void FindAllAll(ReadonlyCollectionIndexPointer pIndex, size_t iLimit,
-                  ItemVector& items);
-  void FindAllLike(ReadonlyCollectionIndexPointer pIndex, size_t iLimit,
-                   const nE_Data* pLike, ItemVector& items);
-  void FindAllMinMax(ReadonlyCollectionIndexPointer pIndex, size_t iLimit,
-                     const nE_Data* pMin, const nE_Data* pMax, ItemVector& items);
-  void FindAllIn(ReadonlyCollectionIndexPointer pIndex, size_t iLimit,
-                 nE_Data* pIn, ItemVector& items);
+  void FindAllAll(ReadonlyCollectionIndexPointer pIndex,
+                  ItemCollector& collector);
+  void FindAllLike(ReadonlyCollectionIndexPointer pIndex,
+                   KeyFilterPointer pKeyFilter, const nE_Data* pLike,
+                   ItemCollector& collector);
+  void FindAllMinMax(ReadonlyCollectionIndexPointer pIndex, const nE_Data* pMin,
+                     const nE_Data* pMax, ItemCollector& collector);
+  void FindAllIn(ReadonlyCollectionIndexPointer pIndex,
+                 KeyFilterPointer pKeyFilter, nE_Data* pIn,
+                 ItemCollector& collector);
+  bool ParseJoin(const nE_DataTable* pQueryTable, ParsedQuery& outerQuery,
+                 ParsedQuery& innerQuery, nE_DataTable& innerQueryTable);
+  void ProbeJoin(const ParsedQuery& innerQuery, JoinProbeVector& probes,
+                 std::vector<ItemVector>& innerItems);
+  bool FindAllColumnRange(const ParsedQuery& parsedQuery, size_t iLimit,
+                          const nE_Data* pField, const nE_Data* pMin,
+                          const nE_Data* pMax, ItemVector& items);
+  bool FindAllColumnScan(const ParsedQuery& parsedQuery, size_t iLimit,
+                         ItemVector& items);
+  bool SortRowsByIndex(const ParsedQuery& parsedQuery,
+                       const ColumnStore& columnStore,
+                       const ColumnStore::RowVector& rows, size_t iLimit,
+                       ItemVector& items);
 
  private:
   nE_Data* FindResult(const ParsedQuery& parsedQuery,
                       const nE_Data* pCollectionItem);
+  nE_Data* JoinResult(const ParsedQuery& outerQuery,
+                      const ParsedQuery& innerQuery, const nE_Data* pResult,
+                      const nE_Data* pOuterItem, const nE_Data* pInnerItem);
+  void InsertItem(const ParsedQuery& parsedQuery, const nE_DataTable* pItem);
   void UpdateItem(const ParsedQuery& parsedQuery, const nE_Data* pCollectionItem);
+  const nE_DataTable* FindStoredItem(const ParsedQuery& parsedQuery,
+                                     const nE_Data* pKey);
   void SendCollectionUpdated(const ParsedQuery& parsedQuery);
+  KeyFilterPointer GetKeyFilter(const ParsedQuery& parsedQuery);
+  static std::string GetIndexName(const ParsedQuery& parsedQuery);
 
  private:
   Database* m_pDatabase;
@@ -0,0 +1,196 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#include "parts/include.h"
+#include "query_cache.h"
+#include "query.h"
+
+namespace parts {
+namespace db {
+
+QueryCache::QueryCache()
+  : m_iCapacity(0),
+    m_iSize(0),
+    m_iHitCount(0),
+    m_iMissCount(0),
+    m_iInvalidationCount(0),
+    m_iEvictionCount(0) {}
+
+void QueryCache::SetCapacity(size_t iCapacity) {
+  m_iCapacity = iCapacity;
+  while (m_iSize > m_iCapacity && !m_Keys.empty()) {
+    Erase(m_Entries.find(m_Keys.back()));
+    ++m_iEvictionCount;
+  }
+}
+
+bool QueryCache::IsEnabled() const {
+  return (m_iCapacity > 0);
+}
+
+QueryResultPointer QueryCache::Find(const std::string& sKey,
+                                    uint64_t iVersion) {
+  EntryMap::iterator it = m_Entries.find(sKey);
+  if (it == m_Entries.end()) {
+    ++m_iMissCount;
+    return QueryResultPointer();
+  }
+  if (it->second.m_iVersion != iVersion) {
+    Erase(it);
+    ++m_iInvalidationCount;
+    ++m_iMissCount;
+    return QueryResultPointer();
+  }
+  m_Keys.splice(m_Keys.begin(), m_Keys, it->second.m_itKey);
+  ++m_iHitCount;
+  return CloneResult(it->second.m_pQueryResult);
+}
+
+void QueryCache::Insert(const std::string& sKey, uint64_t iVersion,
+                        QueryResultPointer pQueryResult, size_t iSize) {
+  EntryMap::iterator it = m_Entries.find(sKey);
+  if (it != m_Entries.end()) {
+    Erase(it);
+  }
+  iSize += sKey.size();
+  if (iSize > m_iCapacity) {
+    return;
+  }
+  while (m_iSize + iSize > m_iCapacity && !m_Keys.empty()) {
+    Erase(m_Entries.find(m_Keys.back()));
+    ++m_iEvictionCount;
+  }
+
+  m_Keys.push_front(sKey);
+  Entry& entry = m_Entries[sKey];
+  entry.m_pQueryResult = CloneResult(pQueryResult);
+  entry.m_iVersion = iVersion;
+  entry.m_iSize = iSize;
+  entry.m_itKey = m_Keys.begin();
+  m_iSize += iSize;
+}
+
+void QueryCache::Clear() {
+  m_Entries.clear();
+  m_Keys.clear();
+  m_iSize = 0;
+}
+
+void QueryCache::GetStatistics(nE_DataTable* pStatistics) const {
+  pStatistics->Push("entries", (int)m_Entries.size());
+  pStatistics->Push("size", (int)m_iSize);
+  pStatistics->Push("capacity", (int)m_iCapacity);
+  pStatistics->Push("hits", (int)m_iHitCount);
+  pStatistics->Push("misses", (int)m_iMissCount);
+  pStatistics->Push("invalidations", (int)m_iInvalidationCount);
+  pStatistics->Push("evictions", (int)m_iEvictionCount);
+}
+
+bool QueryCache::BuildKey(const nE_Data* pQueryData, std::string& sKey,
+                          std::string& sCollectionName) {
+  if (!IsTable(pQueryData)) {
+    return false;
+  }
+  const nE_DataTable* pQueryTable = pQueryData->AsTable();
+  std::string sQueryType(nE_DataUtils::GetAsString(pQueryTable, "query", ""));
+  if ((sQueryType != "find" && sQueryType != "find_all") ||
+      !nE_DataUtils::GetAsBool(pQueryTable, "cache", true)) {
+    return false;
+  }
+  sCollectionName = nE_DataUtils::GetAsString(pQueryTable, "collection", "");
+  sKey.clear();
+  return AppendKey(pQueryData, true, sKey);
+}
+
+bool QueryCache::AppendKey(const nE_Data* pData, bool bIsRoot,
+                           std::string& sKey) {
+  char sNumber[32];
+  if (pData == NULL) {
+    sKey += 'n';
+    return true;
+  }
+  switch (pData->GetType()) {
+    case nE_Data::Data_Int:
+      sprintf(sNumber, "i%d;", pData->AsInt());
+      sKey += sNumber;
+      return true;
+    case nE_Data::Data_Float:
+      sprintf(sNumber, "f%.17g;", (double)pData->AsFloat());
+      sKey += sNumber;
+      return true;
+    case nE_Data::Data_String: {
+      const std::string sValue(pData->AsString());
+      sprintf(sNumber, "s%u:", (unsigned)sValue.size());
+      sKey += sNumber;
+      sKey += sValue;
+      return true;
+    }
+    case nE_Data::Data_Table: {
+      // A nested query may read other collections, so it is never cached.
+      const nE_DataTable* pTable = pData->AsTable();
+      if (!bIsRoot && pTable->IsExist("query")) {
+        return false;
+      }
+      std::map<std::string, const nE_Data*> fields;
+      nE_DataTableConstIterator it = pTable->Begin();
+      for (; it != pTable->End(); ++it) {
+        if (!bIsRoot || it.Key() != "cache") {
+          fields[it.Key()] = it.Value();
+        }
+      }
+      sKey += '{';
+      std::map<std::string, const nE_Data*>::const_iterator itField =
+        fields.begin();
+      for (; itField != fields.end(); ++itField) {
+        sprintf(sNumber, "%u:", (unsigned)itField->first.size());
+        sKey += sNumber;
+        sKey += itField->first;
+        if (!AppendKey(itField->second, false, sKey)) {
+          return false;
+        }
+      }
+      sKey += '}';
+      return true;
+    }
+    case nE_Data::Data_Array: {
+      const nE_DataArray* pArray = pData->AsArray();
+      sKey += '[';
+      for (size_t i = 0; i < pArray->Size(); ++i) {
+        if (!AppendKey(pArray->Get(i), false, sKey)) {
+          return false;
+        }
+      }
+      sKey += ']';
+      return true;
+    }
+    default: {
+      std::string sValue;
+      nE_DataUtils::SaveDataToJsonString(pData, sValue, true);
+      sKey += 'j';
+      sKey += sValue;
+      sKey += ';';
+      return true;
+    }
+  }
+}
+
+QueryResultPointer QueryCache::CloneResult(QueryResultPointer pQueryResult) {
+  nE_DataPointer pResult = pQueryResult->GetResult();
+  if (pResult ==(nE_DataPointer) NULL) {
+    return pQueryResult;
+  }
+  return QueryResultPointer(new QueryResult(nE_DataPointer(pResult->Clone())));
+}
+
+void QueryCache::Erase(EntryMap::iterator it) {
+  m_iSize -= it->second.m_iSize;
+  m_Keys.erase(it->second.m_itKey);
+  m_Entries.erase(it);
+}
+
+}
+}
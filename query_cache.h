@@ -0,0 +1,65 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#ifndef QUERY_CACHE_H_93B7E0F4_2A6D_4C18_B5E9_4F0C8D61A27B
+#define QUERY_CACHE_H_93B7E0F4_2A6D_4C18_B5E9_4F0C8D61A27B
+
+#include "query_result.h"
+#include <list>
+
+namespace parts {
+namespace db {
+
+// LRU cache of find/find_all results keyed on the normalized query content.
+// Every entry remembers the version of its collection and is dropped as soon
+// as the collection has a newer version. Cached results are never handed out
+// themselves, callers get a copy they are free to change.
+class QueryCache {
+ public:
+  QueryCache();
+  void               SetCapacity(size_t iCapacity);
+  bool               IsEnabled() const;
+  QueryResultPointer Find(const std::string& sKey, uint64_t iVersion);
+  void               Insert(const std::string& sKey, uint64_t iVersion,
+                            QueryResultPointer pQueryResult, size_t iSize);
+  void               Clear();
+  void               GetStatistics(nE_DataTable* pStatistics) const;
+  static bool        BuildKey(const nE_Data* pQueryData, std::string& sKey,
+                              std::string& sCollectionName);
+
+ private:
+  typedef std::list<std::string> KeyList;
+
+  struct Entry {
+    QueryResultPointer m_pQueryResult;
+    uint64_t           m_iVersion;
+    size_t             m_iSize;
+    KeyList::iterator  m_itKey;
+  };
+
+  typedef std::map<std::string, Entry> EntryMap;
+
+ private:
+  static bool AppendKey(const nE_Data* pData, bool bIsRoot, std::string& sKey);
+  static QueryResultPointer CloneResult(QueryResultPointer pQueryResult);
+  void        Erase(EntryMap::iterator it);
+
+ private:
+  EntryMap m_Entries;
+  KeyList  m_Keys;
+  size_t   m_iCapacity;
+  size_t   m_iSize;
+  size_t   m_iHitCount;
+  size_t   m_iMissCount;
+  size_t   m_iInvalidationCount;
+  size_t   m_iEvictionCount;
+};
+
+}
+}
+
+#endif//QUERY_CACHE_H_93B7E0F4_2A6D_4C18_B5E9_4F0C8D61A27B
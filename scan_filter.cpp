@@ -0,0 +1,307 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#include "parts/include.h"
+#include "scan_filter.h"
+#include "query_context.h"
+#include "query.h"
+#include <algorithm>
+
+namespace parts {
+namespace db {
+
+namespace {
+
+bool ParseOperation(const std::string& sOperation,
+                    CompareOperation& eOperation) {
+  if (sOperation == "==") {
+    eOperation = Compare_Equal;
+  } else if (sOperation == "!=") {
+    eOperation = Compare_NotEqual;
+  } else if (sOperation == "<") {
+    eOperation = Compare_Less;
+  } else if (sOperation == "<=") {
+    eOperation = Compare_LessEqual;
+  } else if (sOperation == ">") {
+    eOperation = Compare_Greater;
+  } else if (sOperation == ">=") {
+    eOperation = Compare_GreaterEqual;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool CompareStrings(CompareOperation eOperation, const std::string& sLeft,
+                    const std::string& sRight) {
+  switch (eOperation) {
+    case Compare_Equal:
+      return sLeft == sRight;
+    case Compare_NotEqual:
+      return sLeft != sRight;
+    case Compare_Less:
+      return sLeft < sRight;
+    case Compare_LessEqual:
+      return sLeft <= sRight;
+    case Compare_Greater:
+      return sLeft > sRight;
+    default:
+      return sLeft >= sRight;
+  }
+}
+
+}
+
+ScanFilter::Node::Node()
+  : m_eType(Node_Compare),
+    m_eOperation(Compare_Equal),
+    m_bIsNumber(false),
+    m_fValue(0.0) {}
+
+const size_t ScanFilter::BATCH_SIZE;
+
+ScanFilter::Batch::Batch()
+  : m_pItems(NULL),
+    m_iCount(0),
+    m_pColumnStore(NULL),
+    m_pRows(NULL) {}
+
+ScanFilter::ScanFilter() {}
+
+bool ScanFilter::Parse(const nE_Data* pWhere, QueryContext& queryContext,
+                       ErrorStorage& errorStorage) {
+  m_pRoot = ParseNode(pWhere, queryContext, errorStorage);
+  return (m_pRoot !=(NodePointer) NULL);
+}
+
+bool ScanFilter::Match(const nE_DataTable* pItem) const {
+  Batch batch;
+  batch.m_pItems = &pItem;
+  batch.m_iCount = 1;
+  batch.m_vValues.resize(1);
+  batch.m_vPresent.resize(1);
+  uint8_t iMatch = 0;
+  Evaluate(*m_pRoot, batch, &iMatch);
+  return (iMatch != 0);
+}
+
+void ScanFilter::Filter(ItemVector& items, size_t iLimit) const {
+  Batch batch;
+  batch.m_vValues.resize(BATCH_SIZE);
+  batch.m_vPresent.resize(BATCH_SIZE);
+  std::vector<uint8_t> mask(BATCH_SIZE);
+
+  size_t iKept = 0;
+  for (size_t iFirst = 0; iFirst < items.size() && iKept < iLimit;
+       iFirst += BATCH_SIZE) {
+    batch.m_pItems = &items[iFirst];
+    batch.m_iCount = std::min(BATCH_SIZE, items.size() - iFirst);
+    Evaluate(*m_pRoot, batch, &mask[0]);
+    for (size_t i = 0; i < batch.m_iCount && iKept < iLimit; ++i) {
+      if (mask[i]) {
+        items[iKept++] = items[iFirst + i];
+      }
+    }
+  }
+  items.resize(iKept);
+}
+
+void ScanFilter::FilterRows(const ColumnStore& columnStore,
+                            ColumnStore::RowVector& rows, size_t iLimit) const {
+  Batch batch;
+  std::vector<uint8_t> mask(BATCH_SIZE);
+
+  size_t iKept = 0;
+  for (size_t iFirst = 0; iFirst < rows.size() && iKept < iLimit;
+       iFirst += BATCH_SIZE) {
+    const size_t iCount = std::min(BATCH_SIZE, rows.size() - iFirst);
+    EvaluateRows(columnStore, &rows[iFirst], iCount, batch, &mask[0]);
+    for (size_t i = 0; i < iCount && iKept < iLimit; ++i) {
+      if (mask[i]) {
+        rows[iKept++] = rows[iFirst + i];
+      }
+    }
+  }
+  rows.resize(iKept);
+}
+
+void ScanFilter::ScanRows(const ColumnStore& columnStore, size_t iLimit,
+                          ColumnStore::RowVector& rows) const {
+  Batch batch;
+  std::vector<uint8_t> mask(BATCH_SIZE);
+  std::vector<size_t> batchRows(BATCH_SIZE);
+
+  const size_t iRowCount = columnStore.GetRowCount();
+  for (size_t iFirst = 0; iFirst < iRowCount && rows.size() < iLimit;
+       iFirst += BATCH_SIZE) {
+    const size_t iCount = std::min(BATCH_SIZE, iRowCount - iFirst);
+    for (size_t i = 0; i < iCount; ++i) {
+      batchRows[i] = iFirst + i;
+    }
+    EvaluateRows(columnStore, &batchRows[0], iCount, batch, &mask[0]);
+    for (size_t i = 0; i < iCount && rows.size() < iLimit; ++i) {
+      if (mask[i]) {
+        rows.push_back(iFirst + i);
+      }
+    }
+  }
+}
+
+void ScanFilter::EvaluateRows(const ColumnStore& columnStore,
+                              const size_t* pRows, size_t iCount, Batch& batch,
+                              uint8_t* pMask) const {
+  // String conditions still read the item tables, so they are resolved for
+  // the batch once.
+  batch.m_vItems.resize(iCount);
+  for (size_t i = 0; i < iCount; ++i) {
+    batch.m_vItems[i] = columnStore.GetRow(pRows[i]);
+  }
+  batch.m_vValues.resize(BATCH_SIZE);
+  batch.m_vPresent.resize(BATCH_SIZE);
+  batch.m_pItems = &batch.m_vItems[0];
+  batch.m_iCount = iCount;
+  batch.m_pColumnStore = &columnStore;
+  batch.m_pRows = pRows;
+  Evaluate(*m_pRoot, batch, pMask);
+}
+
+ScanFilter::NodePointer ScanFilter::ParseNode(const nE_Data* pWhere,
+    QueryContext& queryContext, ErrorStorage& errorStorage) {
+  if (!IsTable(pWhere)) {
+    errorStorage.Add("It is wrong 'where': a condition must be a table.");
+    return NodePointer();
+  }
+
+  const nE_DataTable* pWhereTable = pWhere->AsTable();
+  NodePointer pNode(new Node());
+  if (pWhereTable->IsExist("and") && pWhereTable->IsExist("or")) {
+    errorStorage.Add("It is wrong 'where': a condition cannot have both 'and' and 'or'.");
+    return NodePointer();
+  } else if (pWhereTable->IsExist("and") || pWhereTable->IsExist("or")) {
+    pNode->m_eType = (pWhereTable->IsExist("and") ? Node_And : Node_Or);
+    const nE_Data* pChildren = pWhereTable->Get(pNode->m_eType == Node_And ?
+                               "and" : "or");
+    if (pChildren->GetType() != nE_Data::Data_Array ||
+        pChildren->AsArray()->Size() == 0) {
+      errorStorage.Add("It is wrong 'where': 'and' and 'or' must be non-empty arrays.");
+      return NodePointer();
+    }
+    const nE_DataArray* pChildArray = pChildren->AsArray();
+    for (size_t i = 0; i < pChildArray->Size(); ++i) {
+      NodePointer pChild = ParseNode(pChildArray->Get(i), queryContext,
+                                     errorStorage);
+      if (pChild ==(NodePointer) NULL) {
+        return NodePointer();
+      }
+      pNode->m_vChildren.push_back(pChild);
+    }
+    return pNode;
+  }
+
+  pNode->m_sField = nE_DataUtils::GetAsString(pWhereTable, "field", "");
+  std::string sOperation(nE_DataUtils::GetAsString(pWhereTable, "op", "=="));
+  if (pNode->m_sField.empty() || !pWhereTable->IsExist("value")) {
+    errorStorage.Add("It is wrong 'where': a condition needs 'field' and 'value'.");
+    return NodePointer();
+  }
+  if (!ParseOperation(sOperation, pNode->m_eOperation)) {
+    errorStorage.Add("It is wrong 'where': unknown 'op'.", sOperation.c_str());
+    return NodePointer();
+  }
+
+  nE_DataPointer pValue(queryContext.CalculateValue(pWhereTable->Get("value"),
+                        "", false));
+  if (pValue ==(nE_DataPointer) NULL) {
+    errorStorage.Add("It is wrong 'where': the 'value' cannot be calculated.");
+    return NodePointer();
+  } else if (pValue->GetType() == nE_Data::Data_Int) {
+    pNode->m_bIsNumber = true;
+    pNode->m_fValue = pValue->AsInt();
+  } else if (pValue->GetType() == nE_Data::Data_Float) {
+    pNode->m_bIsNumber = true;
+    pNode->m_fValue = pValue->AsFloat();
+  } else if (pValue->GetType() == nE_Data::Data_String) {
+    pNode->m_sValue = pValue->AsString();
+  } else {
+    errorStorage.Add("It is wrong 'where': the 'value' must be a number or a string.");
+    return NodePointer();
+  }
+  return pNode;
+}
+
+void ScanFilter::Evaluate(const Node& node, Batch& batch,
+                          uint8_t* pMask) const {
+  if (node.m_eType == Node_Compare) {
+    if (node.m_bIsNumber) {
+      EvaluateNumber(node, batch, pMask);
+    } else {
+      EvaluateString(node, batch, pMask);
+    }
+    return;
+  }
+
+  Evaluate(*node.m_vChildren[0], batch, pMask);
+  std::vector<uint8_t> childMask(batch.m_iCount);
+  for (size_t iChild = 1; iChild < node.m_vChildren.size(); ++iChild) {
+    Evaluate(*node.m_vChildren[iChild], batch, &childMask[0]);
+    if (node.m_eType == Node_And) {
+      for (size_t i = 0; i < batch.m_iCount; ++i) {
+        pMask[i] &= childMask[i];
+      }
+    } else {
+      for (size_t i = 0; i < batch.m_iCount; ++i) {
+        pMask[i] |= childMask[i];
+      }
+    }
+  }
+}
+
+void ScanFilter::EvaluateNumber(const Node& node, Batch& batch,
+                                uint8_t* pMask) const {
+  double* pValues = &batch.m_vValues[0];
+  uint8_t* pPresent = &batch.m_vPresent[0];
+  if (batch.m_pColumnStore != NULL &&
+      batch.m_pColumnStore->GatherNumbers(node.m_sField, batch.m_pRows,
+                                          batch.m_iCount, pValues, pPresent)) {
+    CompareValues(node.m_eOperation, pValues, batch.m_iCount, node.m_fValue,
+                  pMask);
+    for (size_t i = 0; i < batch.m_iCount; ++i) {
+      pMask[i] &= pPresent[i];
+    }
+    return;
+  }
+  for (size_t i = 0; i < batch.m_iCount; ++i) {
+    const nE_Data* pValue = batch.m_pItems[i]->Get(node.m_sField);
+    pPresent[i] = 1;
+    if (pValue != NULL && pValue->GetType() == nE_Data::Data_Int) {
+      pValues[i] = pValue->AsInt();
+    } else if (pValue != NULL && pValue->GetType() == nE_Data::Data_Float) {
+      pValues[i] = pValue->AsFloat();
+    } else {
+      pValues[i] = 0.0;
+      pPresent[i] = 0;
+    }
+  }
+  CompareValues(node.m_eOperation, pValues, batch.m_iCount, node.m_fValue,
+                pMask);
+  for (size_t i = 0; i < batch.m_iCount; ++i) {
+    pMask[i] &= pPresent[i];
+  }
+}
+
+void ScanFilter::EvaluateString(const Node& node, Batch& batch,
+                                uint8_t* pMask) const {
+  for (size_t i = 0; i < batch.m_iCount; ++i) {
+    const nE_Data* pValue = batch.m_pItems[i]->Get(node.m_sField);
+    pMask[i] = (uint8_t)(IsString(pValue) &&
+                         CompareStrings(node.m_eOperation, pValue->AsString(),
+                                        node.m_sValue));
+  }
+}
+
+}
+}
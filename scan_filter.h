@@ -0,0 +1,99 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#ifndef SCAN_FILTER_H_A0E5C3B9_14D8_4F62_8B7E_C9F2136D4A58
+#define SCAN_FILTER_H_A0E5C3B9_14D8_4F62_8B7E_C9F2136D4A58
+
+#include "data_reference.h"
+#include "scan_kernels.h"
+#include "column_store.h"
+
+namespace parts {
+namespace db {
+
+class QueryContext;
+class ErrorStorage;
+
+// The 'where' clause of a query:
+//   {"field": "level", "op": ">=", "value": 10}
+//   {"and": [<where>, ...]}, {"or": [<where>, ...]}
+// Items are filtered in batches: numeric fields of a batch are gathered into
+// a contiguous buffer and compared by the vectorized scan kernels. Rows of a
+// columnar collection take their numeric fields straight from the columns.
+class ScanFilter {
+ public:
+  typedef std::vector<const nE_DataTable*> ItemVector;
+
+  static const size_t BATCH_SIZE = 1024;
+
+ public:
+  ScanFilter();
+  bool Parse(const nE_Data* pWhere, QueryContext& queryContext,
+             ErrorStorage& errorStorage);
+  bool Match(const nE_DataTable* pItem) const;
+  void Filter(ItemVector& items, size_t iLimit) const;
+  void FilterRows(const ColumnStore& columnStore, ColumnStore::RowVector& rows,
+                  size_t iLimit) const;
+  void ScanRows(const ColumnStore& columnStore, size_t iLimit,
+                ColumnStore::RowVector& rows) const;
+
+ private:
+  struct Node;
+  typedef std::shared_ptr<Node> NodePointer;
+  typedef std::vector<NodePointer> NodeVector;
+
+  enum NodeType {
+    Node_And,
+    Node_Or,
+    Node_Compare
+  };
+
+  struct Node {
+    NodeType         m_eType;
+    NodeVector       m_vChildren;
+    std::string      m_sField;
+    CompareOperation m_eOperation;
+    bool             m_bIsNumber;
+    double           m_fValue;
+    std::string      m_sValue;
+
+    Node();
+  };
+
+  struct Batch {
+    const nE_DataTable* const*       m_pItems;
+    size_t                           m_iCount;
+    const ColumnStore*               m_pColumnStore;
+    const size_t*                    m_pRows;
+    std::vector<double>              m_vValues;
+    std::vector<uint8_t>             m_vPresent;
+    std::vector<const nE_DataTable*> m_vItems;
+
+    Batch();
+  };
+
+ private:
+  NodePointer ParseNode(const nE_Data* pWhere, QueryContext& queryContext,
+                        ErrorStorage& errorStorage);
+  void        EvaluateRows(const ColumnStore& columnStore, const size_t* pRows,
+                           size_t iCount, Batch& batch, uint8_t* pMask) const;
+  void        Evaluate(const Node& node, Batch& batch, uint8_t* pMask) const;
+  void        EvaluateNumber(const Node& node, Batch& batch,
+                             uint8_t* pMask) const;
+  void        EvaluateString(const Node& node, Batch& batch,
+                             uint8_t* pMask) const;
+
+ private:
+  NodePointer m_pRoot;
+};
+
+typedef std::shared_ptr<ScanFilter> ScanFilterPointer;
+
+}
+}
+
+#endif//SCAN_FILTER_H_A0E5C3B9_14D8_4F62_8B7E_C9F2136D4A58
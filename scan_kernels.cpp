@@ -0,0 +1,230 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#include "parts/include.h"
+#include "scan_kernels.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PARTS_DB_SCAN_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// clang-cl defines _MSC_VER but not __GNUC__, and like GCC it only compiles
+// the intrinsics inside functions that enable their instruction set.
+#if defined(PARTS_DB_SCAN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PARTS_DB_TARGET_SSE2 __attribute__((target("sse2")))
+#define PARTS_DB_TARGET_AVX2 __attribute__((target("avx2")))
+#define PARTS_DB_TARGET_XSAVE __attribute__((target("xsave")))
+#else
+#define PARTS_DB_TARGET_SSE2
+#define PARTS_DB_TARGET_AVX2
+#define PARTS_DB_TARGET_XSAVE
+#endif
+
+namespace parts {
+namespace db {
+
+namespace {
+
+typedef void (*CompareKernel)(const double* pValues, size_t iCount,
+                              double fValue, uint8_t* pMask);
+
+struct KernelSet {
+  const char*   m_sName;
+  CompareKernel m_pKernels[Compare_Count];
+};
+
+template <CompareOperation eOperation>
+inline bool Compare(double fLeft, double fRight) {
+  switch (eOperation) {
+    case Compare_Equal:
+      return fLeft == fRight;
+    case Compare_NotEqual:
+      return fLeft != fRight;
+    case Compare_Less:
+      return fLeft < fRight;
+    case Compare_LessEqual:
+      return fLeft <= fRight;
+    case Compare_Greater:
+      return fLeft > fRight;
+    default:
+      return fLeft >= fRight;
+  }
+}
+
+template <CompareOperation eOperation>
+void CompareValuesScalar(const double* pValues, size_t iCount, double fValue,
+                         uint8_t* pMask) {
+  for (size_t i = 0; i < iCount; ++i) {
+    pMask[i] = (uint8_t)Compare<eOperation>(pValues[i], fValue);
+  }
+}
+
+const KernelSet SCALAR_KERNELS = {
+  "scalar", {
+    &CompareValuesScalar<Compare_Equal>,
+    &CompareValuesScalar<Compare_NotEqual>,
+    &CompareValuesScalar<Compare_Less>,
+    &CompareValuesScalar<Compare_LessEqual>,
+    &CompareValuesScalar<Compare_Greater>,
+    &CompareValuesScalar<Compare_GreaterEqual>
+  }
+};
+
+#if defined(PARTS_DB_SCAN_X86)
+
+// Four movemask bits spread to four mask bytes.
+const uint32_t MASK_BYTES[16] = {
+  0x00000000, 0x00000001, 0x00000100, 0x00000101,
+  0x00010000, 0x00010001, 0x00010100, 0x00010101,
+  0x01000000, 0x01000001, 0x01000100, 0x01000101,
+  0x01010000, 0x01010001, 0x01010100, 0x01010101
+};
+
+template <CompareOperation eOperation>
+PARTS_DB_TARGET_SSE2 void CompareValuesSse2(const double* pValues,
+    size_t iCount, double fValue, uint8_t* pMask) {
+  const __m128d value = _mm_set1_pd(fValue);
+  size_t i = 0;
+  for (; i + 2 <= iCount; i += 2) {
+    __m128d values = _mm_loadu_pd(pValues + i);
+    __m128d result;
+    switch (eOperation) {
+      case Compare_Equal:
+        result = _mm_cmpeq_pd(values, value);
+        break;
+      case Compare_NotEqual:
+        result = _mm_cmpneq_pd(values, value);
+        break;
+      case Compare_Less:
+        result = _mm_cmplt_pd(values, value);
+        break;
+      case Compare_LessEqual:
+        result = _mm_cmple_pd(values, value);
+        break;
+      case Compare_Greater:
+        result = _mm_cmpgt_pd(values, value);
+        break;
+      default:
+        result = _mm_cmpge_pd(values, value);
+        break;
+    }
+    int iBits = _mm_movemask_pd(result);
+    pMask[i] = (uint8_t)(iBits & 1);
+    pMask[i + 1] = (uint8_t)(iBits >> 1);
+  }
+  CompareValuesScalar<eOperation>(pValues + i, iCount - i, fValue, pMask + i);
+}
+
+template <CompareOperation eOperation, int iPredicate>
+PARTS_DB_TARGET_AVX2 void CompareValuesAvx2(const double* pValues,
+    size_t iCount, double fValue, uint8_t* pMask) {
+  const __m256d value = _mm256_set1_pd(fValue);
+  size_t i = 0;
+  for (; i + 4 <= iCount; i += 4) {
+    __m256d values = _mm256_loadu_pd(pValues + i);
+    int iBits = _mm256_movemask_pd(_mm256_cmp_pd(values, value, iPredicate));
+    memcpy(pMask + i, &MASK_BYTES[iBits], 4);
+  }
+  CompareValuesScalar<eOperation>(pValues + i, iCount - i, fValue, pMask + i);
+}
+
+const KernelSet SSE2_KERNELS = {
+  "sse2", {
+    &CompareValuesSse2<Compare_Equal>,
+    &CompareValuesSse2<Compare_NotEqual>,
+    &CompareValuesSse2<Compare_Less>,
+    &CompareValuesSse2<Compare_LessEqual>,
+    &CompareValuesSse2<Compare_Greater>,
+    &CompareValuesSse2<Compare_GreaterEqual>
+  }
+};
+
+const KernelSet AVX2_KERNELS = {
+  "avx2", {
+    &CompareValuesAvx2<Compare_Equal, _CMP_EQ_OQ>,
+    &CompareValuesAvx2<Compare_NotEqual, _CMP_NEQ_UQ>,
+    &CompareValuesAvx2<Compare_Less, _CMP_LT_OQ>,
+    &CompareValuesAvx2<Compare_LessEqual, _CMP_LE_OQ>,
+    &CompareValuesAvx2<Compare_Greater, _CMP_GT_OQ>,
+    &CompareValuesAvx2<Compare_GreaterEqual, _CMP_GE_OQ>
+  }
+};
+
+bool HasSse2() {
+#if defined(__x86_64__) || defined(_M_X64)
+  return true;
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[3] & (1 << 26)) != 0;
+#elif defined(__GNUC__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2");
+#else
+  return false;
+#endif
+}
+
+PARTS_DB_TARGET_XSAVE bool HasAvx2() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  const int OSXSAVE_AND_AVX = (1 << 27) | (1 << 28);
+  if ((info[2] & OSXSAVE_AND_AVX) != OSXSAVE_AND_AVX ||
+      (_xgetbv(0) & 6) != 6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+#endif
+
+const KernelSet& SelectKernels() {
+#if defined(PARTS_DB_SCAN_X86)
+  if (HasAvx2()) {
+    return AVX2_KERNELS;
+  } else if (HasSse2()) {
+    return SSE2_KERNELS;
+  }
+#endif
+  return SCALAR_KERNELS;
+}
+
+const KernelSet& GetKernels() {
+  static const KernelSet& kernels = SelectKernels();
+  return kernels;
+}
+
+}
+
+void CompareValues(CompareOperation eOperation, const double* pValues,
+                   size_t iCount, double fValue, uint8_t* pMask) {
+  GetKernels().m_pKernels[eOperation](pValues, iCount, fValue, pMask);
+}
+
+const char* GetScanKernelName() {
+  return GetKernels().m_sName;
+}
+
+}
+}
@@ -0,0 +1,33 @@
+//------------------------------------------------------------
+//  Project parts
+//
+//  Created by Dmitry Bystrov.
+//  Copyright 2013 E-STUDIO LLC, Inc. All rights reserved.
+//------------------------------------------------------------
+
+#ifndef SCAN_KERNELS_H_2F8C41D6_97AB_4E03_B5C8_61E0D3A7F925
+#define SCAN_KERNELS_H_2F8C41D6_97AB_4E03_B5C8_61E0D3A7F925
+
+namespace parts {
+namespace db {
+
+enum CompareOperation {
+  Compare_Equal,
+  Compare_NotEqual,
+  Compare_Less,
+  Compare_LessEqual,
+  Compare_Greater,
+  Compare_GreaterEqual,
+  Compare_Count
+};
+
+// Writes 1 to pMask[i] when pValues[i] <op> fValue holds and 0 otherwise.
+// The implementation (AVX2, SSE2 or scalar) is chosen once at runtime.
+void        CompareValues(CompareOperation eOperation, const double* pValues,
+                          size_t iCount, double fValue, uint8_t* pMask);
+const char* GetScanKernelName();
+
+}
+}
+
+#endif//SCAN_KERNELS_H_2F8C41D6_97AB_4E03_B5C8_61E0D3A7F925